@@ -28,6 +28,8 @@
 #include <fast_cgi/thread.hpp>
 #include <fast_cgi/session.hpp>
 #include <fast_cgi/request.hpp>
+#include <fast_cgi/engine.hpp>
+#include <fast_cgi/pool.hpp>
 #include <string.h>
 #include <crypt.hpp>
 #include <fstream>
@@ -74,6 +76,15 @@ namespace FastCGI
 	}
 
 	Application::Application()
+		: m_minThreads(1)
+		, m_maxThreads(0)
+		, m_maxFormSize(DEFAULT_MAX_FORM_SIZE)
+		, m_maxFormFields(DEFAULT_MAX_FORM_FIELDS)
+		, m_maxUploadSize(DEFAULT_MAX_UPLOAD_SIZE)
+		, m_compressionThreshold(DEFAULT_COMPRESSION_THRESHOLD)
+		, m_outputBufferSize(DEFAULT_OUTPUT_BUFFER_SIZE)
+		, m_acceptMode(ACCEPT_SERIALIZED)
+		, m_useEventEngine(false)
 	{
 		m_pid = _getpid();
 		g_app = this;
@@ -83,6 +94,27 @@ namespace FastCGI
 	{
 	}
 
+	void Application::addCookieName(const std::string& name)
+	{
+		if (m_cookieNames.empty())
+			m_cookieNames.push_back(SESSION_COOKIE);
+		if (!isCookieWanted(name.c_str(), name.length()))
+			m_cookieNames.push_back(name);
+	}
+
+	bool Application::isCookieWanted(const char* name, size_t length) const
+	{
+		if (m_cookieNames.empty())
+			return true;
+
+		for (auto&& wanted : m_cookieNames)
+		{
+			if (wanted.length() == length && !memcmp(wanted.c_str(), name, length))
+				return true;
+		}
+		return false;
+	}
+
 	int Application::init(const filesystem::path& localeRoot, const UserInfoFactoryPtr& userInfoFactory)
 	{
 		if (!userInfoFactory)
@@ -104,6 +136,7 @@ namespace FastCGI
 
 		m_sessions.clear(); // dropping all sessions will restart them from DB, with new settings...
 
+		Synchronize on(m_threadLock);
 		for (auto&& thread : m_threads)
 			thread->reload();
 	}
@@ -114,12 +147,59 @@ namespace FastCGI
 		auto cur = first;
 		if (first == end)
 			return;
+
+		if (m_useEventEngine)
+		{
+			m_engine = std::make_shared<impl::EventEngine>();
+			if (m_engine->open(m_listenAddress))
+				m_engine->start();
+			else
+				m_engine.reset();
+		}
+
+		{
+			Synchronize on(m_threadLock);
+			for (auto&& thread : m_threads)
+				thread->prepare();
+		}
+
 		for (++cur; cur != end; ++cur)
 			(*cur)->start();
 
+		if (m_maxThreads)
+		{
+			m_pool = std::make_shared<impl::PoolController>(*this);
+			m_pool->start();
+		}
+
 		(*first)->attach();
 
-		std::for_each(++first, end, [](ThreadPtr thread) { thread->stop(); });
+		if (m_pool)
+		{
+			m_pool->shutdown();
+			m_pool->stop();
+			m_pool.reset();
+		}
+
+		// no one adds or removes the threads anymore
+		std::for_each(++first, m_threads.end(), [](ThreadPtr thread) { thread->stop(); });
+
+		if (m_engine)
+		{
+			m_engine->shutdown();
+			m_engine->stop();
+			m_engine.reset();
+		}
+	}
+
+	std::vector<size_t> Application::getQueueDepths() const
+	{
+		Synchronize on(m_threadLock);
+		std::vector<size_t> depths;
+		depths.reserve(m_threads.size());
+		for (auto&& thread : m_threads)
+			depths.push_back(thread->getQueueDepth());
+		return depths;
 	}
 
 	void Application::shutdown()
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/arena.hpp>
+#include <stdint.h>
+
+namespace FastCGI
+{
+	Arena::Arena(size_t blockSize)
+		: m_blocks(nullptr)
+		, m_next(nullptr)
+		, m_end(nullptr)
+		, m_blockSize(blockSize)
+	{
+	}
+
+	Arena::~Arena()
+	{
+		freeBlocks();
+	}
+
+	Arena::Block* Arena::newBlock(size_t size)
+	{
+		Block* block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+		block->next = nullptr;
+		block->size = size;
+		return block;
+	}
+
+	void Arena::freeBlocks()
+	{
+		while (m_blocks)
+		{
+			Block* next = m_blocks->next;
+			::operator delete(m_blocks);
+			m_blocks = next;
+		}
+		m_next = m_end = nullptr;
+	}
+
+	void* Arena::allocate(size_t size, size_t align)
+	{
+		if (!size)
+			size = 1;
+
+		uintptr_t aligned = ((uintptr_t)m_next + align - 1) & ~(uintptr_t)(align - 1);
+		if (m_blocks && aligned + size <= (uintptr_t)m_end)
+		{
+			m_next = (char*)aligned + size;
+			return (void*)aligned;
+		}
+
+		// oversized requests get a block of their own, kept behind the
+		// current one, so whatever is left of the current block is still used
+		if (size + align > m_blockSize / 2 && m_blocks)
+		{
+			Block* block = newBlock(size + align);
+			block->next = m_blocks->next;
+			m_blocks->next = block;
+			aligned = ((uintptr_t)block->data() + align - 1) & ~(uintptr_t)(align - 1);
+			return (void*)aligned;
+		}
+
+		size_t blockSize = m_blockSize;
+		if (blockSize < size + align)
+			blockSize = size + align;
+
+		Block* block = newBlock(blockSize);
+		block->next = m_blocks;
+		m_blocks = block;
+		m_end = block->data() + block->size;
+
+		aligned = ((uintptr_t)block->data() + align - 1) & ~(uintptr_t)(align - 1);
+		m_next = (char*)aligned + size;
+		return (void*)aligned;
+	}
+
+	void Arena::reset()
+	{
+		if (!m_blocks)
+			return;
+
+		if (!m_blocks->next)
+		{
+			m_next = m_blocks->data();
+			return;
+		}
+
+		// More than one block was needed for the last request; replace
+		// the chain with a single block big enough to hold all of it, so
+		// the next request of that size will not have to grow again.
+		size_t total = 0;
+		for (Block* block = m_blocks; block; block = block->next)
+			total += block->size;
+
+		freeBlocks();
+
+		if (total > MAX_RETAINED_SIZE)
+			total = MAX_RETAINED_SIZE;
+		if (total > m_blockSize)
+			m_blockSize = total;
+
+		m_blocks = newBlock(m_blockSize);
+		m_next = m_blocks->data();
+		m_end = m_next + m_blocks->size;
+	}
+}
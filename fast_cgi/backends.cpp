@@ -27,19 +27,301 @@
 #include <fast_cgi/backends.hpp>
 
 #include <string.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#endif
+
+#define SKIP_CHUNK_SIZE (32 * 1024)
+#define FCGI_VERSION_1 1
+#define FCGI_STDOUT 6
+#define FCGI_MAX_CONTENT 0xFFF8 // largest multiple of 8 fitting the contentLength
+#define RECORDS_PER_WRITE 32
+#define LISTEN_BACKLOG 128
 
 namespace FastCGI
 {
 	namespace impl
 	{
-		LibFCGIRequest::LibFCGIRequest(FCGX_Request& request)
-			: m_streambufCin(request.in)
-			, m_streambufCout(request.out)
-			, m_streambufCerr(request.err)
-			, m_cin(&m_streambufCin)
+		LibFCGIRequest::LibFCGIRequest()
+			: m_in(nullptr)
+			, m_out(nullptr)
+			, m_fd(-1)
+			, m_requestId(0)
+			, m_failed(false)
+			, m_used(0)
 			, m_cout(&m_streambufCout)
 			, m_cerr(&m_streambufCerr)
+			, m_cin(&m_streambufCin)
+		{
+		}
+
+		void resetStream(std::ios& stream)
+		{
+			stream.clear();
+			stream.flags(std::ios_base::dec | std::ios_base::skipws);
+			stream.width(0);
+			stream.precision(6);
+			stream.fill(' ');
+		}
+
+		void LibFCGIRequest::attach(FCGX_Request& request)
+		{
+			m_in = request.in;
+			m_out = request.out;
+			m_fd = request.ipcFd;
+			m_requestId = request.requestId;
+			m_failed = false;
+			m_used = 0;
+			m_streambufCin.attach(request.in);
+			m_streambufCout.attach(request.out);
+			m_streambufCerr.attach(request.err);
+			resetStream(m_cout);
+			resetStream(m_cerr);
+			resetStream(m_cin);
+		}
+
+		long long LibFCGIRequest::skip(long long size)
+		{
+			char buffer[SKIP_CHUNK_SIZE];
+			long long skipped = 0;
+			while (size < 0 || skipped < size)
+			{
+				int chunk = sizeof(buffer);
+				if (size >= 0 && size - skipped < chunk)
+					chunk = (int)(size - skipped);
+
+				int got = FCGX_GetStr(buffer, chunk, m_in);
+				if (got > 0)
+					skipped += got;
+				if (got < chunk)
+					break; // end of input
+			}
+			return skipped;
+		}
+
+		void LibFCGIRequest::setBufferSize(size_t size)
+		{
+#ifdef _WIN32
+			size = 0; // ipcFd is not a descriptor writev could use
+#endif
+			m_buffer.resize(size);
+			m_used = 0;
+		}
+
+		void LibFCGIRequest::write(const char* data, size_t size)
+		{
+			if (m_buffer.empty())
+			{
+				FCGX_PutStr(data, (int)size, m_out);
+				return;
+			}
+
+			size_t room = m_buffer.size() - m_used;
+			if (size < room)
+			{
+				memcpy(m_buffer.data() + m_used, data, size);
+				m_used += size;
+				return;
+			}
+
+			memcpy(m_buffer.data() + m_used, data, room);
+			m_used += room;
+			data += room;
+			size -= room;
+			sendBuffer();
+
+			// no point in copying anything bigger than the buffer
+			if (size >= m_buffer.size())
+			{
+				sendRecords(data, size);
+				return;
+			}
+
+			memcpy(m_buffer.data(), data, size);
+			m_used = size;
+		}
+
+		void LibFCGIRequest::sendBuffer()
+		{
+			if (!m_used)
+				return;
+
+			// the headers, and anything written through cout(), go first
+			FCGX_FFlush(m_out);
+			sendRecords(m_buffer.data(), m_used);
+			m_used = 0;
+		}
+
+#ifdef _WIN32
+		void LibFCGIRequest::sendRecords(const char* data, size_t size)
 		{
+			FCGX_PutStr(data, (int)size, m_out);
+		}
+#else
+		static bool writeAll(int fd, iovec* iov, int count)
+		{
+			while (count)
+			{
+				ssize_t written = writev(fd, iov, count);
+				if (written < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					return false;
+				}
+
+				while (count && (size_t)written >= iov->iov_len)
+				{
+					written -= iov->iov_len;
+					++iov;
+					--count;
+				}
+				if (count)
+				{
+					iov->iov_base = (char*)iov->iov_base + written;
+					iov->iov_len -= written;
+				}
+			}
+			return true;
+		}
+
+		void LibFCGIRequest::sendRecords(const char* data, size_t size)
+		{
+			if (m_failed || m_fd < 0)
+				return;
+
+			unsigned char headers[RECORDS_PER_WRITE][8];
+			iovec iov[RECORDS_PER_WRITE * 2];
+			while (size)
+			{
+				int count = 0;
+				for (; size && count < RECORDS_PER_WRITE; ++count)
+				{
+					size_t length = size < FCGI_MAX_CONTENT ? size : FCGI_MAX_CONTENT;
+					unsigned char* header = headers[count];
+					header[0] = FCGI_VERSION_1;
+					header[1] = FCGI_STDOUT;
+					header[2] = (unsigned char)(m_requestId >> 8);
+					header[3] = (unsigned char)m_requestId;
+					header[4] = (unsigned char)(length >> 8);
+					header[5] = (unsigned char)length;
+					header[6] = 0; // no padding
+					header[7] = 0;
+
+					iov[2 * count].iov_base = header;
+					iov[2 * count].iov_len = 8;
+					iov[2 * count + 1].iov_base = (void*)data;
+					iov[2 * count + 1].iov_len = length;
+					data += length;
+					size -= length;
+				}
+
+				if (!writeAll(m_fd, iov, 2 * count))
+				{
+					// the server went away; the rest of the response goes nowhere
+					m_failed = true;
+					return;
+				}
+			}
+		}
+#endif
+
+		LibFCGIThread::~LibFCGIThread()
+		{
+#ifndef _WIN32
+			if (m_listenSock > 0)
+				::close(m_listenSock);
+#endif
+		}
+
+#ifdef _WIN32
+		int listenOn(const std::string&)
+		{
+			return -1;
+		}
+#else
+		int listenOn(const std::string& address)
+		{
+#ifndef SO_REUSEPORT
+			return -1;
+#else
+			size_t colon = address.rfind(':');
+			if (colon == std::string::npos)
+				return -1; // a path; the kernel does not balance local sockets
+
+			std::string host = address.substr(0, colon);
+			std::string port = address.substr(colon + 1);
+			if (host.length() > 1 && host[0] == '[' && host[host.length() - 1] == ']')
+				host = host.substr(1, host.length() - 2);
+
+			addrinfo hints;
+			memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			hints.ai_flags = AI_PASSIVE;
+
+			addrinfo* info = nullptr;
+			if (getaddrinfo(host.empty() || host == "*" ? nullptr : host.c_str(), port.c_str(), &hints, &info))
+				return -1;
+
+			int sock = -1;
+			for (addrinfo* ai = info; ai && sock < 0; ai = ai->ai_next)
+			{
+				sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+				if (sock < 0)
+					continue;
+
+				int one = 1;
+				if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+					setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) ||
+					bind(sock, ai->ai_addr, ai->ai_addrlen) ||
+					::listen(sock, LISTEN_BACKLOG))
+				{
+					::close(sock);
+					sock = -1;
+				}
+			}
+			freeaddrinfo(info);
+			return sock;
+#endif
+		}
+#endif
+
+		bool LibFCGIThread::listen(const std::string& address)
+		{
+			int sock = listenOn(address);
+			if (sock < 0)
+				return false;
+
+#ifndef _WIN32
+			if (m_listenSock > 0)
+				::close(m_listenSock);
+#endif
+			m_listenSock = sock;
+			return true;
+		}
+
+		long long STLRequest::skip(long long size)
+		{
+			char buffer[SKIP_CHUNK_SIZE];
+			long long skipped = 0;
+			while (size < 0 || skipped < size)
+			{
+				std::streamsize chunk = sizeof(buffer);
+				if (size >= 0 && size - skipped < chunk)
+					chunk = (std::streamsize)(size - skipped);
+
+				std::cin.read(buffer, chunk);
+				std::streamsize got = std::cin.gcount();
+				skipped += got;
+				if (got < chunk)
+					break;
+			}
+			return skipped;
 		}
 
 		static inline char* dup(const char* src)
@@ -71,7 +353,7 @@ namespace FastCGI
 			environment[3] = REQUEST_URI;
 			environment[4] = "SERVER_PORT=80";
 			environment[5] = "SERVER_NAME=www.reedr.net";
-			environment[6] = "HTTP_COOKIE=reader.login=...";
+			environment[6] = "HTTP_COOKIE=" SESSION_COOKIE "=...";
 			environment[7] = NULL;
 		}
 
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/compression.hpp>
+#include "text.hpp"
+#include <zlib.h>
+#include <string.h>
+#include <stdlib.h>
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		enum
+		{
+			WINDOW_BITS = 15,
+			GZIP_HEADER = 16, // added to the window bits
+			MEM_LEVEL = 8,
+			CHUNK_SIZE = 16 * 1024
+		};
+
+		Compressor::Compressor()
+			: m_stream(nullptr)
+			, m_encoding(NONE)
+		{
+		}
+
+		Compressor::~Compressor()
+		{
+			end();
+		}
+
+		void Compressor::end()
+		{
+			if (m_stream)
+			{
+				deflateEnd(m_stream);
+				delete m_stream;
+			}
+			m_stream = nullptr;
+			m_encoding = NONE;
+		}
+
+		bool Compressor::start(Encoding encoding)
+		{
+			if (encoding == NONE)
+				return false;
+
+			if (m_stream && m_encoding == encoding)
+				return deflateReset(m_stream) == Z_OK;
+
+			end();
+
+			m_stream = new z_stream;
+			memset(m_stream, 0, sizeof(z_stream));
+			int windowBits = encoding == GZIP ? WINDOW_BITS + GZIP_HEADER : WINDOW_BITS;
+			if (deflateInit2(m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+			{
+				delete m_stream;
+				m_stream = nullptr;
+				return false;
+			}
+
+			m_encoding = encoding;
+			return true;
+		}
+
+		void Compressor::write(const char* data, size_t size, bool last, ResponseSink& out)
+		{
+			if (!m_stream)
+				return;
+
+			// anything written before the last piece was flushed on purpose,
+			// so it has to leave the compressor as well
+			int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+			char buffer[CHUNK_SIZE];
+
+			m_stream->next_in = (Bytef*)data;
+			m_stream->avail_in = (uInt)size;
+			do
+			{
+				m_stream->next_out = (Bytef*)buffer;
+				m_stream->avail_out = sizeof(buffer);
+				if (deflate(m_stream, flush) == Z_STREAM_ERROR)
+					return;
+				size_t have = sizeof(buffer) - m_stream->avail_out;
+				if (have)
+					out.write(buffer, have);
+			} while (m_stream->avail_out == 0);
+		}
+
+		static inline bool token(const char* c, const char* end, const char* lit)
+		{
+			return text::iequals(c, end - c, lit);
+		}
+
+		// qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] ), in thousandths;
+		// parsed by hand, as strtod() would follow the LC_NUMERIC
+		static inline int qvalue(const char*& c)
+		{
+			int q = 0;
+			if (*c == '0' || *c == '1')
+				q = (*c++ - '0') * 1000;
+			if (*c == '.')
+			{
+				++c;
+				for (int scale = 100; scale && *c >= '0' && *c <= '9'; scale /= 10)
+					q += (*c++ - '0') * scale;
+			}
+			while (*c >= '0' && *c <= '9') ++c;
+			return q > 1000 ? 1000 : q;
+		}
+
+		// gzip;q=1.0, deflate;q=0.5, *;q=0
+		Compressor::Encoding Compressor::negotiate(const char* acceptEncoding)
+		{
+			if (!acceptEncoding)
+				return NONE;
+
+			// -1 for the codings not listed; "*" only speaks for those
+			int gzip = -1, deflate = -1, any = -1;
+			const char* c = acceptEncoding;
+			while (*c)
+			{
+				while (*c == ' ' || *c == '\t' || *c == ',') ++c;
+				const char* name = c;
+				while (*c && *c != ',' && *c != ';' && *c != ' ' && *c != '\t') ++c;
+				const char* name_end = c;
+
+				int q = 1000;
+				while (*c && *c != ',')
+				{
+					if (*c++ != ';')
+						continue;
+					while (*c == ' ' || *c == '\t') ++c;
+					if ((*c == 'q' || *c == 'Q') && c[1] == '=')
+					{
+						c += 2;
+						q = qvalue(c);
+					}
+				}
+
+				if (token(name, name_end, "gzip") || token(name, name_end, "x-gzip"))
+					gzip = q > gzip ? q : gzip;
+				else if (token(name, name_end, "deflate"))
+					deflate = q > deflate ? q : deflate;
+				else if (token(name, name_end, "*"))
+					any = q > any ? q : any;
+			}
+
+			if (gzip < 0)
+				gzip = any;
+			if (deflate < 0)
+				deflate = any;
+
+			// the highest q wins, gzip on a tie
+			if (gzip > 0 && gzip >= deflate)
+				return GZIP;
+			if (deflate > 0)
+				return DEFLATE;
+			return NONE;
+		}
+
+		const char* Compressor::name(Encoding encoding)
+		{
+			switch (encoding)
+			{
+			case GZIP: return "gzip";
+			case DEFLATE: return "deflate";
+			default: break;
+			}
+			return nullptr;
+		}
+
+		static inline bool contains(const char* c, const char* end, const char* lit)
+		{
+			size_t len = strlen(lit);
+			for (; (size_t)(end - c) >= len; ++c)
+			{
+				if (token(c, c + len, lit))
+					return true;
+			}
+			return false;
+		}
+
+		bool Compressor::compressible(const param_view& contentType)
+		{
+			const char* c = contentType.begin();
+			const char* end = (const char*)memchr(c, ';', contentType.size());
+			if (!end)
+				end = contentType.end();
+
+			if (end - c >= 5 && token(c, c + 5, "text/"))
+				return true;
+
+			return contains(c, end, "json")
+				|| contains(c, end, "javascript")
+				|| contains(c, end, "xml");
+		}
+	}
+}
@@ -0,0 +1,974 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/engine.hpp>
+#include <fast_cgi/backends.hpp>
+#include <fast_cgi/protocol.hpp>
+#include <string.h>
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		using namespace protocol;
+
+		void QueuedRequest::feed(const char* data, size_t size)
+		{
+			std::lock_guard<std::mutex> guard(m_inputLock);
+			if (m_inputClosed)
+				return;
+
+			// counted here, so the handler can never take more than was counted
+			m_conn->m_buffered += size;
+			m_input.append(data, size);
+			m_inputReady.notify_one();
+		}
+
+		void QueuedRequest::endInput()
+		{
+			std::lock_guard<std::mutex> guard(m_inputLock);
+			m_inputEnd = true;
+			m_inputReady.notify_one();
+		}
+
+		void QueuedRequest::abort()
+		{
+			m_aborted = true;
+			std::lock_guard<std::mutex> guard(m_inputLock);
+			m_inputReady.notify_one();
+		}
+
+		bool QueuedRequest::done()
+		{
+			std::lock_guard<std::mutex> guard(m_inputLock);
+			return m_inputClosed;
+		}
+
+		bool QueuedRequest::take(std::string& chunk)
+		{
+			chunk.clear();
+			{
+				std::unique_lock<std::mutex> lock(m_inputLock);
+				m_inputReady.wait(lock, [this] { return !m_input.empty() || m_inputEnd || m_inputClosed || m_aborted; });
+				if (m_input.empty() || m_aborted)
+					return false;
+				chunk.swap(m_input);
+			}
+
+			m_conn->consumed(chunk.size());
+			return true;
+		}
+
+		size_t QueuedRequest::closeInput()
+		{
+			size_t left;
+			{
+				std::lock_guard<std::mutex> guard(m_inputLock);
+				m_inputClosed = true;
+				left = m_input.size();
+				std::string().swap(m_input);
+			}
+			m_conn->consumed(left);
+			return left;
+		}
+
+#ifdef __linux__
+		void EngineConnection::send(const char* data, size_t size)
+		{
+			Chunk chunk = { data, size };
+			std::lock_guard<std::mutex> guard(m_lock);
+			sendLocked(&chunk, 1);
+		}
+
+		void EngineConnection::sendRecords(unsigned char type, unsigned short id, const char* data, size_t size)
+		{
+			unsigned char headers[MAX_BATCH][HEADER_SIZE];
+			Chunk chunks[2 * MAX_BATCH];
+
+			while (size)
+			{
+				size_t count = 0;
+				for (size_t record = 0; record < MAX_BATCH && size; ++record)
+				{
+					size_t length = size < MAX_CONTENT ? size : MAX_CONTENT;
+					recordHeader(headers[record], type, id, length);
+					chunks[count].data = (const char*)headers[record];
+					chunks[count++].size = HEADER_SIZE;
+					chunks[count].data = data;
+					chunks[count++].size = length;
+					data += length;
+					size -= length;
+				}
+
+				// one batch at a time, so the other requests on this
+				// connection get their turn between the batches
+				std::unique_lock<std::mutex> lock(m_lock);
+				sendLocked(chunks, count);
+
+				// the web server does not keep up; wait for the engine to
+				// send some of it, instead of piling up the whole response
+				if (m_output.size() > OUTPUT_HIGH_WATER)
+					m_drained.wait(lock, [this] { return m_closed || m_output.size() <= OUTPUT_LOW_WATER; });
+			}
+		}
+
+		void EngineConnection::sendLocked(Chunk* chunks, size_t count)
+		{
+			if (m_closed)
+				return;
+
+			if (m_output.empty())
+			{
+				iovec iov[2 * MAX_BATCH];
+				for (size_t i = 0; i < count; ++i)
+				{
+					iov[i].iov_base = (void*)chunks[i].data;
+					iov[i].iov_len = chunks[i].size;
+				}
+
+				msghdr msg;
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_iov = iov;
+				msg.msg_iovlen = count;
+
+				ssize_t written = sendmsg(m_fd, &msg, MSG_NOSIGNAL);
+				if (written < 0)
+				{
+					if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+					{
+						// the engine will notice and drop the connection
+						::shutdown(m_fd, SHUT_RDWR);
+						return;
+					}
+					written = 0;
+				}
+
+				size_t sent = (size_t)written;
+				while (count && sent >= chunks->size)
+				{
+					sent -= chunks->size;
+					++chunks;
+					--count;
+				}
+
+				if (!count)
+					return;
+
+				chunks->data += sent;
+				chunks->size -= sent;
+
+				// the rest is sent by the engine, once the socket is ready
+				m_wantOutput = true;
+				m_engine.watch(*this);
+			}
+
+			for (size_t i = 0; i < count; ++i)
+				m_output.append(chunks[i].data, chunks[i].size);
+		}
+
+		void EngineConnection::finished(const QueuedRequestPtr& request, const char* records, size_t size)
+		{
+			// the web server may reuse the id as soon as it sees the
+			// END_REQUEST; by then, this request must be gone
+			Chunk chunk = { records, size };
+			m_paramBytes -= request->m_paramBytes;
+
+			std::lock_guard<std::mutex> guard(m_lock);
+			auto _it = m_running.find(request->m_id);
+			if (_it != m_running.end() && _it->second == request)
+				m_running.erase(_it);
+			sendLocked(&chunk, 1);
+
+			if (m_closed || request->m_keepConn)
+				return;
+
+			if (m_output.empty())
+				::shutdown(m_fd, SHUT_RDWR);
+			else
+				m_closeWhenSent = true;
+		}
+
+		void EngineConnection::pause()
+		{
+			if (m_buffered <= INPUT_HIGH_WATER)
+				return;
+
+			// checked again under the lock; a handler may have just taken it
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (m_closed || m_paused || m_buffered <= INPUT_HIGH_WATER)
+				return;
+			m_paused = true;
+			m_engine.watch(*this);
+		}
+
+		bool EngineConnection::paused()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_paused;
+		}
+
+		void EngineConnection::consumed(size_t size)
+		{
+			if (!size || (m_buffered -= size) > INPUT_LOW_WATER)
+				return;
+
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (m_closed || !m_paused || m_buffered > INPUT_LOW_WATER)
+				return;
+			m_paused = false;
+			m_engine.watch(*this);
+		}
+
+		EventEngine::EventEngine()
+			: m_listen(-1)
+			, m_epoll(-1)
+			, m_wakeup(-1)
+			, m_ownsListen(false)
+			, m_listening(false)
+			, m_stopping(false)
+		{
+		}
+
+		EventEngine::~EventEngine()
+		{
+			if (m_ownsListen && m_listen >= 0)
+				::close(m_listen);
+			if (m_epoll >= 0)
+				::close(m_epoll);
+			if (m_wakeup >= 0)
+				::close(m_wakeup);
+		}
+
+		bool EventEngine::open(const std::string& address)
+		{
+			if (!address.empty())
+			{
+				m_listen = listenOn(address);
+				m_ownsListen = m_listen >= 0;
+			}
+
+			if (m_listen < 0)
+			{
+				// FCGI_LISTENSOCK_FILENO, if it is a listening socket at all
+				int listening = 0;
+				socklen_t length = sizeof(listening);
+				if (getsockopt(0, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) || !listening)
+					return false;
+				m_listen = 0;
+			}
+
+			fcntl(m_listen, F_SETFL, fcntl(m_listen, F_GETFL) | O_NONBLOCK);
+
+			m_epoll = epoll_create1(EPOLL_CLOEXEC);
+			m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (m_epoll < 0 || m_wakeup < 0)
+				return false;
+
+			epoll_event ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.fd = m_listen;
+			if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listen, &ev))
+				return false;
+			m_listening = true;
+			ev.data.fd = m_wakeup;
+			return !epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev);
+		}
+
+		void EventEngine::shutdown()
+		{
+			m_stopping = true;
+			m_scheduler.shutdown();
+
+			if (m_wakeup >= 0)
+			{
+				uint64_t one = 1;
+				while (::write(m_wakeup, &one, sizeof(one)) < 0 && errno == EINTR) {}
+			}
+		}
+
+		void EventEngine::watch(EngineConnection& conn)
+		{
+			// a paused connection still hears of EPOLLHUP and EPOLLERR
+			epoll_event ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.events = (conn.m_paused ? 0 : EPOLLIN | EPOLLRDHUP) | (conn.m_wantOutput ? EPOLLOUT : 0);
+			ev.data.fd = conn.m_fd;
+			epoll_ctl(m_epoll, EPOLL_CTL_MOD, conn.m_fd, &ev);
+		}
+
+		void EventEngine::run()
+		{
+			epoll_event events[MAX_EVENTS];
+			while (!m_stopping)
+			{
+				int count = epoll_wait(m_epoll, events, MAX_EVENTS, m_listening ? -1 : ACCEPT_BACKOFF);
+				if (count < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					break;
+				}
+
+				// the descriptors may have been freed by someone else
+				if (!m_listening && std::chrono::steady_clock::now() >= m_retryAccept)
+					listen(true);
+
+				for (int i = 0; i < count && !m_stopping; ++i)
+				{
+					int fd = events[i].data.fd;
+					if (fd == m_wakeup)
+					{
+						uint64_t value;
+						while (::read(m_wakeup, &value, sizeof(value)) > 0) {}
+						continue;
+					}
+
+					if (fd == m_listen)
+					{
+						acceptAll();
+						continue;
+					}
+
+					auto _it = m_connections.find(fd);
+					if (_it == m_connections.end())
+						continue;
+
+					EngineConnectionPtr conn = _it->second;
+					if (events[i].events & (EPOLLHUP | EPOLLERR))
+					{
+						drop(conn);
+						continue;
+					}
+
+					if (events[i].events & EPOLLOUT)
+						writable(conn);
+					if (events[i].events & (EPOLLIN | EPOLLRDHUP))
+						readable(conn);
+				}
+			}
+
+			m_stopping = true;
+			while (!m_connections.empty())
+				drop(m_connections.begin()->second);
+		}
+
+		void EventEngine::acceptAll()
+		{
+			while (true)
+			{
+				int fd = accept4(m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (fd < 0)
+				{
+					if (errno == EINTR || errno == ECONNABORTED)
+						continue;
+
+					// the listening socket stays readable, so instead of
+					// spinning on it, wait for a connection to go away
+					if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+						listen(false);
+					return;
+				}
+
+				if (m_connections.size() >= MAX_CONNECTIONS)
+				{
+					::close(fd);
+					continue;
+				}
+
+				int one = 1;
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on local sockets
+
+				epoll_event ev;
+				memset(&ev, 0, sizeof(ev));
+				ev.events = EPOLLIN | EPOLLRDHUP;
+				ev.data.fd = fd;
+				if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev))
+				{
+					::close(fd);
+					continue;
+				}
+
+				m_connections[fd] = std::make_shared<EngineConnection>(*this, fd);
+			}
+		}
+
+		void EventEngine::listen(bool enable)
+		{
+			if (m_listening == enable)
+				return;
+
+			epoll_event ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.fd = m_listen;
+			if (!epoll_ctl(m_epoll, enable ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, m_listen, &ev))
+				m_listening = enable;
+			if (!enable)
+				m_retryAccept = std::chrono::steady_clock::now() + std::chrono::milliseconds(ACCEPT_BACKOFF);
+		}
+
+		void EventEngine::drop(const EngineConnectionPtr& conn)
+		{
+			int fd = conn->m_fd;
+			{
+				std::lock_guard<std::mutex> guard(conn->m_lock);
+				if (!conn->m_closed)
+				{
+					epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+					::close(fd);
+					conn->m_closed = true;
+				}
+				std::string().swap(conn->m_output);
+				for (auto&& running : conn->m_running)
+					running.second->abort();
+				conn->m_running.clear();
+				conn->m_drained.notify_all();
+			}
+			conn->m_receiving.clear();
+			m_connections.erase(fd);
+
+			if (!m_stopping)
+				listen(true);
+		}
+
+		void EventEngine::writable(const EngineConnectionPtr& conn)
+		{
+			std::lock_guard<std::mutex> guard(conn->m_lock);
+			if (conn->m_closed)
+				return;
+
+			size_t sent = 0;
+			std::string& output = conn->m_output;
+			while (sent < output.length())
+			{
+				ssize_t written = ::send(conn->m_fd, output.data() + sent, output.length() - sent, MSG_NOSIGNAL);
+				if (written < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					if (errno != EAGAIN && errno != EWOULDBLOCK)
+						::shutdown(conn->m_fd, SHUT_RDWR);
+					break;
+				}
+				sent += written;
+			}
+			output.erase(0, sent);
+			if (output.size() <= EngineConnection::OUTPUT_LOW_WATER)
+				conn->m_drained.notify_all();
+
+			if (!output.empty())
+				return;
+
+			conn->m_wantOutput = false;
+			watch(*conn);
+			if (conn->m_closeWhenSent)
+				::shutdown(conn->m_fd, SHUT_RDWR);
+		}
+
+		void EventEngine::readable(const EngineConnectionPtr& conn)
+		{
+			// A chunk at a time, each parsed before the next one is read,
+			// so the unparsed input never holds more than a chunk and
+			// a record. After a few chunks, the other connections get
+			// their turn; the socket stays readable, so this one is back
+			// in the next round.
+			char buffer[READ_CHUNK_SIZE];
+			for (int round = 0; round < MAX_READS; ++round)
+			{
+				if (conn->paused())
+					return;
+
+				ssize_t got = ::recv(conn->m_fd, buffer, sizeof(buffer), 0);
+				if (got < 0 && errno == EINTR)
+					continue;
+				if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+					return;
+				if (got <= 0)
+				{
+					drop(conn);
+					return;
+				}
+
+				conn->m_input.append(buffer, got);
+				if (!parse(conn) || (size_t)got < sizeof(buffer))
+					return;
+			}
+		}
+
+		bool EventEngine::parse(const EngineConnectionPtr& conn)
+		{
+			const std::string& input = conn->m_input;
+			size_t pos = 0;
+			while (true)
+			{
+				Record rec;
+				size_t consumed;
+				ReadResult result = readRecord(input.data() + pos, input.length() - pos, rec, consumed);
+				if (result == PARTIAL)
+					break;
+				if (result == MALFORMED)
+				{
+					drop(conn);
+					return false;
+				}
+
+				record(conn, rec);
+				if (conn->m_closed)
+					return false;
+				pos += consumed;
+			}
+			conn->m_input.erase(0, pos);
+			return true;
+		}
+
+		void EventEngine::record(const EngineConnectionPtr& conn, const Record& rec)
+		{
+			if (!rec.id)
+			{
+				if (rec.type == GET_VALUES)
+					getValues(conn, rec.content, rec.length);
+				else
+				{
+					unsigned char reply[2 * HEADER_SIZE];
+					recordHeader(reply, UNKNOWN_TYPE, 0, 8);
+					memset(reply + HEADER_SIZE, 0, 8);
+					reply[HEADER_SIZE] = rec.type;
+					conn->send((const char*)reply, sizeof(reply));
+				}
+				return;
+			}
+
+			if (rec.type == BEGIN_REQUEST)
+			{
+				beginRequest(conn, rec.id, rec.content, rec.length);
+				return;
+			}
+
+			if (rec.type == ABORT_REQUEST)
+			{
+				abortRequest(conn, rec.id);
+				return;
+			}
+
+			auto _it = conn->m_receiving.find(rec.id);
+			if (_it == conn->m_receiving.end())
+				return; // not active; ignored, as the spec says
+			QueuedRequestPtr request = _it->second;
+
+			if (rec.type == PARAMS)
+			{
+				if (!request->m_envp.empty())
+					return; // after the end of the params
+
+				if (!rec.length)
+				{
+					if (!decodeParams(request->m_params, request->m_envp))
+						drop(conn);
+					else
+						handOver(conn, request);
+					return;
+				}
+
+				if (request->m_paramBytes + rec.length > EngineConnection::MAX_PARAMS_SIZE)
+				{
+					refuse(conn, request, "431 Request Header Fields Too Large");
+					return;
+				}
+
+				if (conn->m_paramBytes + rec.length > EngineConnection::MAX_CONNECTION_PARAMS)
+				{
+					refuse(conn, request, "503 Service Unavailable");
+					return;
+				}
+
+				request->m_params.append(rec.content, rec.length);
+				request->m_paramBytes += rec.length;
+				conn->m_paramBytes += rec.length;
+				return;
+			}
+
+			if (rec.type == STDIN)
+			{
+				// a request without the end of the params still needs the envp terminator
+				if (request->m_envp.empty())
+				{
+					if (!decodeParams(request->m_params, request->m_envp))
+					{
+						drop(conn);
+						return;
+					}
+					handOver(conn, request);
+				}
+
+				if (rec.length)
+				{
+					request->feed(rec.content, rec.length);
+					conn->pause();
+					return;
+				}
+
+				request->endInput();
+				conn->m_receiving.erase(_it);
+			}
+		}
+
+		void EventEngine::handOver(const EngineConnectionPtr& conn, const QueuedRequestPtr& request)
+		{
+			// the stdin, if any, follows; the handler waits for it
+			{
+				std::lock_guard<std::mutex> guard(conn->m_lock);
+				conn->m_running[request->m_id] = request;
+			}
+			push(request);
+		}
+
+		void EventEngine::refuse(const EngineConnectionPtr& conn, const QueuedRequestPtr& request, const char* status)
+		{
+			conn->m_receiving.erase(request->m_id);
+
+			std::string body = "Status: ";
+			body.append(status);
+			body.append("\r\nContent-Type: text/plain\r\n\r\n");
+
+			std::string records(HEADER_SIZE, 0);
+			recordHeader((unsigned char*)&records[0], STDOUT, request->m_id, body.length());
+			records.append(body);
+
+			unsigned char tail[3 * HEADER_SIZE];
+			recordHeader(tail, STDOUT, request->m_id, 0);
+			endRequest(tail + HEADER_SIZE, request->m_id, REQUEST_COMPLETE);
+			records.append((const char*)tail, sizeof(tail));
+
+			conn->finished(request, records.data(), records.length());
+		}
+
+		void EventEngine::beginRequest(const EngineConnectionPtr& conn, unsigned short id, const char* content, size_t length)
+		{
+			if (length < 8)
+				return;
+
+			// the ones whose handler has already finished, but the web
+			// server never sent the end of their stdin
+			for (auto _it = conn->m_receiving.begin(); _it != conn->m_receiving.end();)
+			{
+				if (_it->second->done())
+					_it = conn->m_receiving.erase(_it);
+				else
+					++_it;
+			}
+
+			if (conn->m_receiving.count(id))
+				return;
+
+			size_t active = 0;
+			{
+				std::lock_guard<std::mutex> guard(conn->m_lock);
+				if (conn->m_running.count(id))
+					return;
+				active = conn->m_running.size();
+				for (auto&& receiving : conn->m_receiving)
+				{
+					if (!conn->m_running.count(receiving.first))
+						++active;
+				}
+			}
+
+			unsigned short role = (unsigned short)((unsigned char)content[0] << 8 | (unsigned char)content[1]);
+			if (role != RESPONDER || active >= EngineConnection::MAX_REQUESTS)
+			{
+				unsigned char reply[2 * HEADER_SIZE];
+				endRequest(reply, id, role != RESPONDER ? UNKNOWN_ROLE : OVERLOADED);
+				conn->send((const char*)reply, sizeof(reply));
+				return;
+			}
+
+			conn->m_receiving[id] = std::make_shared<QueuedRequest>(conn, id, !!(content[2] & KEEP_CONN));
+		}
+
+		void EventEngine::abortRequest(const EngineConnectionPtr& conn, unsigned short id)
+		{
+			auto _it = conn->m_receiving.find(id);
+			if (_it != conn->m_receiving.end())
+			{
+				QueuedRequestPtr request = _it->second;
+				conn->m_receiving.erase(_it);
+				if (request->m_envp.empty())
+				{
+					// no handler has seen it yet
+					unsigned char reply[2 * HEADER_SIZE];
+					endRequest(reply, id, REQUEST_COMPLETE);
+					conn->finished(request, (const char*)reply, sizeof(reply));
+					return;
+				}
+			}
+
+			// the handler thread still sends the END_REQUEST
+			std::lock_guard<std::mutex> guard(conn->m_lock);
+			auto running = conn->m_running.find(id);
+			if (running != conn->m_running.end())
+				running->second->abort();
+		}
+
+		void EventEngine::getValues(const EngineConnectionPtr& conn, const char* content, size_t length)
+		{
+			std::string values;
+			const char* c = content;
+			const char* end = content + length;
+			const char* name;
+			size_t nameLength;
+			while (c < end && nextName(c, end, name, nameLength))
+			{
+				std::string value;
+				if (nameLength == 14 && !memcmp(name, "FCGI_MAX_CONNS", 14))
+					value = std::to_string((int)MAX_CONNECTIONS);
+				else if (nameLength == 13 && !memcmp(name, "FCGI_MAX_REQS", 13))
+					value = std::to_string((int)MAX_CONNECTIONS);
+				else if (nameLength == 15 && !memcmp(name, "FCGI_MPXS_CONNS", 15))
+					value = "0"; // see EngineConnection
+				else
+					continue;
+
+				appendNameValue(values, name, nameLength, value);
+			}
+
+			std::string reply(HEADER_SIZE, 0);
+			recordHeader((unsigned char*)&reply[0], GET_VALUES_RESULT, 0, values.length());
+			reply.append(values);
+			conn->send(reply.data(), reply.length());
+		}
+
+		void EventEngine::push(const QueuedRequestPtr& request)
+		{
+			m_scheduler.push(request);
+		}
+#else
+		// no epoll; the application falls back to the libfcgi threads
+
+		void EngineConnection::send(const char*, size_t) {}
+		void EngineConnection::sendRecords(unsigned char, unsigned short, const char*, size_t) {}
+		void EngineConnection::finished(const QueuedRequestPtr&, const char*, size_t) {}
+		void EngineConnection::pause() {}
+		bool EngineConnection::paused() { return false; }
+		void EngineConnection::consumed(size_t) {}
+
+		EventEngine::EventEngine()
+			: m_listen(-1)
+			, m_epoll(-1)
+			, m_wakeup(-1)
+			, m_ownsListen(false)
+			, m_listening(false)
+			, m_stopping(false)
+		{
+		}
+
+		EventEngine::~EventEngine() {}
+		bool EventEngine::open(const std::string&) { return false; }
+		void EventEngine::run() {}
+
+		void EventEngine::shutdown()
+		{
+			m_stopping = true;
+			m_scheduler.shutdown();
+		}
+#endif
+
+		EngineRequest::EngineRequest()
+			: m_coutBuffer(*this, STDOUT)
+			, m_cerrBuffer(*this, STDERR)
+			, m_cout(&m_coutBuffer)
+			, m_cerr(&m_cerrBuffer)
+			, m_cin(&m_inputBuffer)
+			, m_errorsSent(false)
+		{
+		}
+
+		void EngineRequest::InputBuffer::reset(const QueuedRequestPtr& request)
+		{
+			m_request = request;
+			setg(nullptr, nullptr, nullptr);
+		}
+
+		void EngineRequest::InputBuffer::clear()
+		{
+			// whatever the handler did not read is thrown away,
+			// and so is the rest of the stdin, once it arrives
+			if (m_request)
+				m_request->closeInput();
+			m_request.reset();
+			m_chunk.clear();
+			setg(nullptr, nullptr, nullptr);
+		}
+
+		EngineRequest::InputBuffer::int_type EngineRequest::InputBuffer::underflow()
+		{
+			if (gptr() < egptr())
+				return traits_type::to_int_type(*gptr());
+
+			if (!m_request || !m_request->take(m_chunk))
+			{
+				setg(nullptr, nullptr, nullptr);
+				return traits_type::eof();
+			}
+
+			setg(&m_chunk[0], &m_chunk[0], &m_chunk[0] + m_chunk.length());
+			return traits_type::to_int_type(*gptr());
+		}
+
+		std::streamsize EngineRequest::InputBuffer::skip(std::streamsize size)
+		{
+			std::streamsize skipped = egptr() - gptr();
+			if (size >= 0 && skipped > size)
+			{
+				setg(eback(), gptr() + size, egptr());
+				return size;
+			}
+
+			// the handler does not wait for a slow client to send what
+			// it does not want; the engine drops the rest as it comes
+			m_chunk.clear();
+			setg(nullptr, nullptr, nullptr);
+			if (m_request)
+				skipped += (std::streamsize)m_request->closeInput();
+			return skipped;
+		}
+
+		EngineRequest::OutputBuffer::int_type EngineRequest::OutputBuffer::overflow(int_type ch)
+		{
+			if (traits_type::eq_int_type(ch, traits_type::eof()))
+				return traits_type::not_eof(ch);
+			char c = traits_type::to_char_type(ch);
+			m_owner.send(m_type, &c, 1);
+			return ch;
+		}
+
+		std::streamsize EngineRequest::OutputBuffer::xsputn(const char* data, std::streamsize size)
+		{
+			m_owner.send(m_type, data, (size_t)size);
+			return size;
+		}
+
+		void EngineRequest::attach(const QueuedRequestPtr& request)
+		{
+			m_request = request;
+			m_inputBuffer.reset(request);
+			m_errorsSent = false;
+			resetStream(m_cout);
+			resetStream(m_cerr);
+			resetStream(m_cin);
+		}
+
+		void EngineRequest::write(const char* data, size_t size)
+		{
+			send(STDOUT, data, size);
+		}
+
+		long long EngineRequest::skip(long long size)
+		{
+			return m_inputBuffer.skip((std::streamsize)size);
+		}
+
+		void EngineRequest::send(unsigned char type, const char* data, size_t size)
+		{
+			if (!m_request || !size || m_request->m_aborted)
+				return;
+
+			if (type == STDERR)
+				m_errorsSent = true;
+
+			m_request->m_conn->sendRecords(type, m_request->m_id, data, size);
+		}
+
+		void EngineRequest::finish()
+		{
+			if (!m_request)
+				return;
+
+			// the ends of the streams and the END_REQUEST, in one piece
+			unsigned char records[4 * HEADER_SIZE];
+			unsigned char* out = records;
+			recordHeader(out, STDOUT, m_request->m_id, 0);
+			out += HEADER_SIZE;
+			if (m_errorsSent)
+			{
+				recordHeader(out, STDERR, m_request->m_id, 0);
+				out += HEADER_SIZE;
+			}
+			endRequest(out, m_request->m_id, REQUEST_COMPLETE);
+			out += 2 * HEADER_SIZE;
+
+			// before the END_REQUEST, so a paused connection is resumed
+			// for the next request
+			m_inputBuffer.clear();
+			m_request->m_conn->finished(m_request, (const char*)records, out - records);
+			m_request.reset();
+		}
+
+		static const char* const s_noEnvironment[] = { nullptr };
+
+		const char * const* EngineThread::envp() const
+		{
+			return m_current ? m_current->m_envp.data() : s_noEnvironment;
+		}
+
+		EngineThread::~EngineThread()
+		{
+			m_engine->scheduler().detach(m_slot);
+		}
+
+		void EngineThread::init()
+		{
+			if (m_slot == Scheduler::NO_SLOT)
+				m_slot = m_engine->scheduler().attach();
+		}
+
+		bool EngineThread::accept()
+		{
+			m_current = m_engine->scheduler().next(m_slot);
+			if (!m_current)
+				return false;
+
+			m_requestBackend.attach(m_current);
+			return true;
+		}
+
+		void EngineThread::release()
+		{
+			m_requestBackend.finish();
+			m_current.reset();
+		}
+	}
+}
@@ -28,19 +28,48 @@
 
 namespace FastCGI { namespace app {
 
+	static inline const HandlerPtr& handlerOf(const HandlerMap::value_type& pair)
+	{
+#if DEBUG_CGI
+		return pair.second.ptr;
+#else
+		return pair.second;
+#endif
+	}
+
 	HandlerPtr Handlers::_handler(Request& request)
 	{
 		param_t REQUEST_URI = request.getParam("REQUEST_URI");
 		if (REQUEST_URI == nullptr) return nullptr;
 		param_t query = strchr(REQUEST_URI, '?');
+		std::string resource = query ? std::string(REQUEST_URI, query) : REQUEST_URI;
 
-		HandlerMap::iterator _it = m_handlers.find(query ? std::string(REQUEST_URI, query) : REQUEST_URI);
-		if (_it == m_handlers.end()) return nullptr;
-#if DEBUG_CGI
-		return _it->second.ptr;
-#else
-		return _it->second;
-#endif
+		HandlerPtr ptr;
+		HandlerMap::iterator _it = m_handlers.find(resource);
+		if (_it != m_handlers.end())
+			ptr = handlerOf(*_it);
+		else
+		{
+			// "/static/css/site.css" is looked for in "/static/css/", then "/static/"
+			// and finally "/"; only subtree handlers may answer such a request
+			size_t pos = resource.length();
+			while (pos && (pos = resource.rfind('/', pos - 1)) != std::string::npos)
+			{
+				_it = m_handlers.find(resource.substr(0, pos + 1));
+				if (_it != m_handlers.end() && handlerOf(*_it) && handlerOf(*_it)->servesSubtree())
+				{
+					ptr = handlerOf(*_it);
+					break;
+				}
+			}
+		}
+
+		if (ptr)
+		{
+			request.allowUploads(ptr->allowsUploads());
+			request.allowCompression(ptr->allowsCompression());
+		}
+		return ptr;
 	}
 
 }} // FastCGI::app
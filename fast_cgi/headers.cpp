@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/headers.hpp>
+#include "text.hpp"
+#include <string.h>
+
+namespace FastCGI
+{
+	namespace
+	{
+		struct KnownHeader
+		{
+			const char* name;
+			size_t length;
+		};
+
+#define KNOWN(name) { name, sizeof(name) - 1 }
+		// in the order of the HeaderId
+		static const KnownHeader known[] = {
+			KNOWN("Status"),
+			KNOWN("Content-Type"),
+			KNOWN("Content-Length"),
+			KNOWN("Content-Disposition"),
+			KNOWN("Content-Encoding"),
+			KNOWN("Content-Range"),
+			KNOWN("Location"),
+			KNOWN("Last-Modified"),
+			KNOWN("Set-Cookie"),
+			KNOWN("Cache-Control"),
+			KNOWN("Expires"),
+			KNOWN("ETag"),
+			KNOWN("Vary"),
+			KNOWN("Accept-Ranges")
+		};
+#undef KNOWN
+	}
+
+	ResponseHeaders::ResponseHeaders(const ArenaAllocator<char>& alloc)
+		: m_alloc(alloc)
+		, m_headers(ArenaAllocator<Header>(alloc))
+	{
+		m_headers.reserve(8);
+	}
+
+	HeaderId ResponseHeaders::lookup(const char* name, size_t length)
+	{
+		for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); ++i)
+		{
+			if (known[i].length == length && impl::text::iequals(known[i].name, name, length))
+				return (HeaderId)i;
+		}
+		return HEADER_UNKNOWN;
+	}
+
+	const char* ResponseHeaders::name(HeaderId id)
+	{
+		if (id >= HEADER_UNKNOWN)
+			return nullptr;
+		return known[id].name;
+	}
+
+	ResponseHeaders::Header* ResponseHeaders::find(HeaderId id, const char* name, size_t length)
+	{
+		for (auto&& header : m_headers)
+		{
+			if (header.m_id != id)
+				continue;
+			if (id != HEADER_UNKNOWN)
+				return &header;
+			if (header.m_nameLength == length && impl::text::iequals(header.m_line.data(), name, length))
+				return &header;
+		}
+		return nullptr;
+	}
+
+	const ResponseHeaders::Header* ResponseHeaders::find(HeaderId id) const
+	{
+		for (auto&& header : m_headers)
+		{
+			if (header.m_id == id)
+				return &header;
+		}
+		return nullptr;
+	}
+
+	void ResponseHeaders::set(HeaderId id, const char* value, size_t length)
+	{
+		const KnownHeader& info = known[id];
+		set(id, info.name, info.length, value, length);
+	}
+
+	void ResponseHeaders::set(const char* name, size_t nameLength, const char* value, size_t valueLength)
+	{
+		set(lookup(name, nameLength), name, nameLength, value, valueLength);
+	}
+
+	void ResponseHeaders::set(HeaderId id, const char* name, size_t nameLength, const char* value, size_t valueLength)
+	{
+		Header* header = find(id, name, nameLength);
+		if (!header)
+		{
+			m_headers.push_back(Header(id, nameLength, m_alloc));
+			header = &m_headers.back();
+		}
+
+		header->m_nameLength = nameLength;
+		header->m_line.reserve(nameLength + 2 + valueLength);
+		header->m_line.assign(name, nameLength).append(": ", 2).append(value, valueLength);
+	}
+
+	void ResponseHeaders::remove(HeaderId id)
+	{
+		for (auto it = m_headers.begin(); it != m_headers.end(); ++it)
+		{
+			if (it->m_id == id)
+			{
+				m_headers.erase(it);
+				return;
+			}
+		}
+	}
+
+	param_view ResponseHeaders::get(HeaderId id) const
+	{
+		const Header* header = find(id);
+		if (!header)
+			return param_view();
+		return header->value();
+	}
+}
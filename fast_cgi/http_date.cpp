@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/http_date.hpp>
+
+namespace FastCGI
+{
+	static inline char* two(char* out, int value)
+	{
+		*out++ = (char)('0' + value / 10);
+		*out++ = (char)('0' + value % 10);
+		return out;
+	}
+
+	void HttpDate::update(tyme::time_t time)
+	{
+		static const char days[] = "ThuFriSatSunMonTueWed"; // 1970-01-01 was a Thursday
+		static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+		long long day = time / 86400;
+		long long secs = time % 86400;
+		if (secs < 0)
+		{
+			secs += 86400;
+			--day;
+		}
+
+		int weekday = (int)(day % 7);
+		if (weekday < 0)
+			weekday += 7;
+
+		// civil date from the days since the epoch, in the 400-year eras
+		// starting on the 1st of March, so the leap day is the last day
+		long long z = day + 719468;
+		long long era = (z >= 0 ? z : z - 146096) / 146097;
+		long long doe = z - era * 146097;
+		long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		long long mp = (5 * doy + 2) / 153;
+		int mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+		int month = (int)(mp < 10 ? mp + 2 : mp - 10);
+		long long year = yoe + era * 400 + (month < 2 ? 1 : 0);
+
+		if (year < 0 || year > 9999)
+		{
+			m_length = 0;
+			m_date[0] = 0;
+			return;
+		}
+
+		char sep = m_style == COOKIE ? '-' : ' ';
+		char* out = m_date;
+		memcpy(out, days + weekday * 3, 3); out += 3;
+		*out++ = ',';
+		*out++ = ' ';
+		out = two(out, mday);
+		*out++ = sep;
+		memcpy(out, months + month * 3, 3); out += 3;
+		*out++ = sep;
+		out = two(out, (int)(year / 100));
+		out = two(out, (int)(year % 100));
+		*out++ = ' ';
+		out = two(out, (int)(secs / 3600));
+		*out++ = ':';
+		out = two(out, (int)(secs / 60 % 60));
+		*out++ = ':';
+		out = two(out, (int)(secs % 60));
+		memcpy(out, " GMT", 5); out += 4;
+
+		m_time = time;
+		m_length = out - m_date;
+	}
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/json.hpp>
+#include <fast_cgi/request.hpp>
+#include "scan.hpp"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace FastCGI
+{
+	static const char* json_escape(char c)
+	{
+		switch (c)
+		{
+		case '"':  return "\\\"";
+		case '\\': return "\\\\";
+		case '\n': return "\\n";
+		case '\r': return "\\r";
+		case '\t': return "\\t";
+		case '\b': return "\\b";
+		case '\f': return "\\f";
+		}
+		return nullptr;
+	}
+
+	static ResponseBuffer& jsonOutput(Request& request)
+	{
+		if (!request.hasHeader(HEADER_CONTENT_TYPE))
+			request.setHeader(HEADER_CONTENT_TYPE, "application/json; charset=utf-8");
+		return request.output();
+	}
+
+	JsonWriter::JsonWriter(Request& request)
+		: m_out(jsonOutput(request))
+		, m_hasItems(0)
+		, m_depth(0)
+		, m_refused(0)
+		, m_afterKey(false)
+	{
+	}
+
+	JsonWriter::JsonWriter(ResponseBuffer& out)
+		: m_out(out)
+		, m_hasItems(0)
+		, m_depth(0)
+		, m_refused(0)
+		, m_afterKey(false)
+	{
+	}
+
+	bool JsonWriter::separate()
+	{
+		if (m_refused)
+			return false;
+
+		if (m_afterKey)
+		{
+			m_afterKey = false;
+			return true;
+		}
+
+		if (!m_depth)
+			return true;
+
+		uint64_t bit = 1ull << (m_depth - 1);
+		if (m_hasItems & bit)
+			m_out.append(',');
+		else
+			m_hasItems |= bit;
+		return true;
+	}
+
+	JsonWriter& JsonWriter::open(char c)
+	{
+		if (m_refused || m_depth >= MAX_DEPTH)
+		{
+			assert(m_refused || !"JsonWriter: nested deeper than MAX_DEPTH");
+			if (separate())
+				m_out.append("null", 4);
+			++m_refused;
+			return *this;
+		}
+
+		separate();
+		m_out.append(c);
+		++m_depth;
+		m_hasItems &= ~(1ull << (m_depth - 1));
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::close(char c)
+	{
+		if (m_refused)
+		{
+			--m_refused;
+			return *this;
+		}
+
+		if (m_depth)
+			--m_depth;
+		m_afterKey = false;
+		m_out.append(c);
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::key(const param_view& name)
+	{
+		if (!separate())
+			return *this;
+		string(name.data(), name.size());
+		m_out.append(':');
+		m_afterKey = true;
+		return *this;
+	}
+
+	void JsonWriter::string(const char* data, size_t size)
+	{
+		const char* end = data + size;
+		m_out.append('"');
+		while (data < end)
+		{
+			const char* esc = impl::scan::find_json_escape(data, end);
+			m_out.append(data, esc - data);
+			if (esc == end)
+				break;
+
+			const char* replacement = json_escape(*esc);
+			if (replacement)
+				m_out.append(replacement, 2);
+			else
+			{
+				char buffer[7];
+				sprintf(buffer, "\\u%04x", (unsigned char)*esc);
+				m_out.append(buffer, 6);
+			}
+			data = esc + 1;
+		}
+		m_out.append('"');
+	}
+
+	JsonWriter& JsonWriter::value(bool value)
+	{
+		if (!separate())
+			return *this;
+		if (value)
+			m_out.append("true", 4);
+		else
+			m_out.append("false", 5);
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::value(double value)
+	{
+		// JSON has no NaN or Infinity
+		if (value != value || value - value != 0)
+			return null();
+
+		if (!separate())
+			return *this;
+
+		// the shortest of the two, which reads back as the same number
+		char buffer[32];
+		int length = snprintf(buffer, sizeof(buffer), "%.15g", value);
+		if (strtod(buffer, nullptr) != value)
+			length = snprintf(buffer, sizeof(buffer), "%.17g", value);
+		if (length <= 0)
+			return *this;
+
+		// snprintf() follows the LC_NUMERIC, JSON always has the dot
+		for (int i = 0; i < length; ++i)
+		{
+			char c = buffer[i];
+			if ((c < '0' || c > '9') && c != '-' && c != '+' && c != 'e')
+				buffer[i] = '.';
+		}
+		m_out.append(buffer, (size_t)length);
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::null()
+	{
+		if (separate())
+			m_out.append("null", 4);
+		return *this;
+	}
+}
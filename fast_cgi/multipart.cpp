@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/multipart.hpp>
+#include "text.hpp"
+#include <string.h>
+#include <stdio.h>
+
+namespace FastCGI
+{
+	UploadedFile::~UploadedFile()
+	{
+		if (m_owned)
+			remove(m_path.c_str());
+	}
+
+	bool UploadedFile::saveAs(const std::string& path)
+	{
+		if (m_path.empty())
+			return false;
+
+		if (rename(m_path.c_str(), path.c_str()))
+			return false;
+
+		m_path = path;
+		m_owned = false;
+		return true;
+	}
+
+	namespace impl
+	{
+		static size_t find(const char* data, size_t size, const std::string& needle)
+		{
+			size_t len = needle.length();
+			if (size < len)
+				return std::string::npos;
+
+			const char* c = data;
+			const char* last = data + size - len;
+			while (c <= last)
+			{
+				c = (const char*)memchr(c, needle[0], last - c + 1);
+				if (!c)
+					break;
+				if (!memcmp(c, needle.data(), len))
+					return c - data;
+				++c;
+			}
+			return std::string::npos;
+		}
+
+		// form-data; name="field"; filename="file.txt"
+		static void dispositionParams(const char* c, const char* end, UploadInfo& info, bool& isFile)
+		{
+			while (c < end)
+			{
+				const char* semi = c;
+				while (semi < end && *semi != ';') ++semi;
+				if (semi == end)
+					return;
+				c = semi + 1;
+
+				while (c < end && text::is_space(*c)) ++c;
+				const char* name = c;
+				while (c < end && *c != '=' && *c != ';') ++c;
+				const char* name_end = c;
+				text::trim(name, name_end);
+				if (c == end || *c != '=')
+					continue;
+				++c;
+
+				std::string value;
+				while (c < end && text::is_space(*c)) ++c;
+				if (c < end && *c == '"')
+				{
+					++c;
+					while (c < end && *c != '"')
+					{
+						if (*c == '\\' && c + 1 < end) ++c;
+						value.push_back(*c++);
+					}
+					if (c < end) ++c;
+				}
+				else
+				{
+					const char* value_start = c;
+					while (c < end && *c != ';') ++c;
+					const char* value_end = c;
+					text::trim(value_start, value_end);
+					value.assign(value_start, value_end);
+				}
+
+				if (text::iequals(name, name_end - name, "name"))
+					info.name = std::move(value);
+				else if (text::iequals(name, name_end - name, "filename"))
+				{
+					// IE sends the full path of the file
+					auto pos = value.find_last_of("/\\");
+					if (pos != std::string::npos)
+						value = value.substr(pos + 1);
+					info.filename = std::move(value);
+					isFile = true;
+				}
+			}
+		}
+
+		MultipartParser::MultipartParser(const std::string& boundary, MultipartHandler& handler, size_t maxFieldSize)
+			: m_handler(handler)
+			, m_delimiter("\r\n--" + boundary)
+			, m_maxFieldSize(maxFieldSize)
+			, m_maxHeaderSize(DEFAULT_MAX_HEADER_SIZE)
+			, m_state(PREAMBLE)
+			, m_tooLarge(false)
+			, m_isFile(false)
+			, m_skip(false)
+		{
+		}
+
+		std::string MultipartParser::boundary(const char* contentType)
+		{
+			const char* c = contentType ? strchr(contentType, ';') : nullptr;
+			while (c)
+			{
+				++c;
+				while (text::is_space(*c)) ++c;
+				if (!strncmp(c, "boundary=", 9))
+				{
+					c += 9;
+					const char* end;
+					if (*c == '"')
+					{
+						++c;
+						end = strchr(c, '"');
+						if (!end)
+							return std::string();
+					}
+					else
+					{
+						end = c;
+						while (*end && *end != ';' && !text::is_space(*end)) ++end;
+					}
+					return std::string(c, end);
+				}
+				c = strchr(c, ';');
+			}
+			return std::string();
+		}
+
+		bool MultipartParser::parseHeaders(const char* data, size_t size)
+		{
+			m_part = UploadInfo();
+			m_isFile = false;
+			m_skip = false;
+			m_field.clear();
+
+			const char* c = data;
+			const char* end = data + size;
+			while (c < end)
+			{
+				const char* line_end = c;
+				while (line_end < end && *line_end != '\r') ++line_end;
+
+				const char* colon = (const char*)memchr(c, ':', line_end - c);
+				if (colon)
+				{
+					const char* name = c;
+					const char* name_end = colon;
+					const char* value = colon + 1;
+					const char* value_end = line_end;
+					text::trim(name, name_end);
+					text::trim(value, value_end);
+
+					if (text::iequals(name, name_end - name, "content-disposition"))
+						dispositionParams(value, value_end, m_part, m_isFile);
+					else if (text::iequals(name, name_end - name, "content-type"))
+						m_part.contentType.assign(value, value_end);
+				}
+
+				c = line_end + 2;
+			}
+
+			if (m_part.name.empty())
+				return false;
+
+			if (m_isFile)
+			{
+				m_skip = m_part.filename.empty();
+				if (!m_skip && !m_handler.onFileOpen(m_part))
+					return false;
+			}
+			return true;
+		}
+
+		bool MultipartParser::partData(const char* data, size_t size)
+		{
+			if (!size || m_skip)
+				return true;
+
+			if (m_isFile)
+				return m_handler.onFileData(data, size);
+
+			if (m_field.length() + size > m_maxFieldSize)
+			{
+				m_tooLarge = true;
+				return false;
+			}
+
+			m_field.append(data, size);
+			return true;
+		}
+
+		bool MultipartParser::partEnd()
+		{
+			if (m_isFile)
+			{
+				if (!m_skip)
+					m_handler.onFileClose();
+				return true;
+			}
+
+			return m_handler.onField(m_part.name, m_field);
+		}
+
+		bool MultipartParser::feed(const char* data, size_t size)
+		{
+			if (m_state == FAILED)
+				return false;
+			if (m_state == EPILOGUE)
+				return true;
+
+			m_buffer.append(data, size);
+
+			const char* begin = m_buffer.data();
+			size_t len = m_buffer.length();
+			size_t pos = 0;
+			bool more = true;
+
+			while (more && m_state != FAILED)
+			{
+				switch (m_state)
+				{
+				case PREAMBLE:
+				{
+					// the first boundary does not need the CRLF in front
+					size_t dashLen = m_delimiter.length() - 2;
+					size_t at = find(begin + pos, len - pos, m_delimiter.substr(2));
+					if (at == std::string::npos)
+					{
+						if (len - pos >= dashLen)
+							pos = len - dashLen + 1;
+						more = false;
+						break;
+					}
+					pos += at + dashLen;
+					m_state = AFTER_BOUNDARY;
+					break;
+				}
+
+				case AFTER_BOUNDARY:
+				{
+					if (len - pos < 2)
+					{
+						more = false;
+						break;
+					}
+
+					if (begin[pos] == '-' && begin[pos + 1] == '-')
+					{
+						m_state = EPILOGUE;
+						pos = len;
+						more = false;
+						break;
+					}
+
+					// skip the transport padding
+					size_t at = find(begin + pos, len - pos, "\r\n");
+					if (at == std::string::npos)
+					{
+						if (len - pos > m_maxHeaderSize)
+						{
+							m_state = FAILED;
+							m_tooLarge = true;
+						}
+						more = false;
+						break;
+					}
+					pos += at + 2;
+					m_state = HEADERS;
+					break;
+				}
+
+				case HEADERS:
+				{
+					size_t at = 0;
+					if (len - pos >= 2 && begin[pos] == '\r' && begin[pos + 1] == '\n')
+						at = 0; // no headers at all
+					else
+					{
+						at = find(begin + pos, len - pos, "\r\n\r\n");
+						if (at == std::string::npos)
+						{
+							if (len - pos > m_maxHeaderSize)
+							{
+								m_state = FAILED;
+								m_tooLarge = true;
+							}
+							more = false;
+							break;
+						}
+						at += 2;
+					}
+
+					if (!parseHeaders(begin + pos, at))
+					{
+						m_state = FAILED;
+						break;
+					}
+
+					pos += at + 2;
+					m_state = BODY;
+					break;
+				}
+
+				case BODY:
+				{
+					size_t at = find(begin + pos, len - pos, m_delimiter);
+					if (at == std::string::npos)
+					{
+						// everything, except what might be a beginning of the delimiter
+						size_t keep = m_delimiter.length() - 1;
+						if (len - pos > keep)
+						{
+							size_t safe = len - pos - keep;
+							if (!partData(begin + pos, safe))
+								m_state = FAILED;
+							pos += safe;
+						}
+						more = false;
+						break;
+					}
+
+					if (!partData(begin + pos, at) || !partEnd())
+					{
+						m_state = FAILED;
+						break;
+					}
+
+					pos += at + m_delimiter.length();
+					m_state = AFTER_BOUNDARY;
+					break;
+				}
+
+				default:
+					more = false;
+					break;
+				}
+			}
+
+			m_buffer.erase(0, pos);
+			return m_state != FAILED;
+		}
+
+		bool TempFileSink::open(const UploadInfo&)
+		{
+			close();
+
+#ifdef _WIN32
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4996)
+#endif
+			char* name = _tempnam(nullptr, "upload-");
+			if (!name)
+				return false;
+			m_path = name;
+			free(name);
+			m_file = fopen(m_path.c_str(), "wb");
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+#else
+			const char* dir = getenv("TMPDIR");
+			if (!dir || !*dir)
+				dir = "/tmp";
+			m_path = dir;
+			m_path += "/upload-XXXXXX";
+			int fd = mkstemp(&m_path[0]);
+			if (fd < 0)
+			{
+				m_path.clear();
+				return false;
+			}
+			m_file = fdopen(fd, "wb");
+			if (!m_file)
+				::close(fd);
+#endif
+			if (!m_file)
+			{
+				remove(m_path.c_str());
+				m_path.clear();
+				return false;
+			}
+			return true;
+		}
+
+		bool TempFileSink::write(const char* data, size_t size)
+		{
+			return m_file && fwrite(data, 1, size, m_file) == size;
+		}
+
+		void TempFileSink::close()
+		{
+			if (m_file)
+				fclose(m_file);
+			m_file = nullptr;
+		}
+	}
+}
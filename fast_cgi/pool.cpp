@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/pool.hpp>
+#include <fast_cgi/application.hpp>
+#include <fast_cgi/thread.hpp>
+#include <fast_cgi/engine.hpp>
+#include <chrono>
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		PoolController::PoolController(Application& app)
+			: m_app(app)
+			, m_stopping(false)
+			, m_idleSamples(0)
+		{
+		}
+
+		void PoolController::run()
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			while (!m_stopping)
+			{
+				m_wake.wait_for(lock, std::chrono::milliseconds(SAMPLE_INTERVAL));
+				if (m_stopping)
+					break;
+
+				lock.unlock();
+				adjust();
+				lock.lock();
+			}
+		}
+
+		void PoolController::shutdown()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_stopping = true;
+			m_wake.notify_all();
+		}
+
+		size_t PoolController::reap(unsigned long& load)
+		{
+			std::vector<ThreadPtr> finished;
+			size_t live = 0;
+			load = 0;
+
+			{
+				Synchronize on(m_app.m_threadLock);
+
+				// the first thread runs on the main thread and is never let go
+				auto first = m_app.m_threads.begin();
+				for (auto _it = first; _it != m_app.m_threads.end();)
+				{
+					ThreadPtr thread = *_it;
+					if (_it != first && thread->finished())
+					{
+						finished.push_back(thread);
+						_it = m_app.m_threads.erase(_it);
+						continue;
+					}
+					++_it;
+
+					if (thread->retiring())
+						continue;
+
+					thread->sampleLoad();
+					load += thread->getLoad();
+					++live;
+				}
+			}
+
+			// out of their run() already, nothing to wait for
+			for (auto&& thread : finished)
+				thread->stop();
+
+			if (live)
+				load /= live;
+			return live;
+		}
+
+		void PoolController::grow(size_t live)
+		{
+			if (!m_app.m_threadFactory)
+				return;
+
+			// a quarter more each time, so a busy morning
+			// does not take a minute to catch up with
+			size_t count = live / 4 + 1;
+			if (live + count > m_app.m_maxThreads)
+				count = m_app.m_maxThreads - live;
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				ThreadPtr thread = m_app.m_threadFactory();
+				if (!thread)
+					return;
+
+				thread->prepare();
+				{
+					Synchronize on(m_app.m_threadLock);
+					m_app.m_threads.push_back(thread);
+				}
+				thread->start();
+			}
+		}
+
+		void PoolController::shrink()
+		{
+			Synchronize on(m_app.m_threadLock);
+
+			// the youngest first; a thread with a SO_REUSEPORT socket of
+			// its own stays, as closing the socket would reset all the
+			// connections the kernel already queued on it
+			auto first = m_app.m_threads.begin();
+			for (auto _it = m_app.m_threads.end(); _it != first;)
+			{
+				--_it;
+				if (_it != first && !(*_it)->retiring() && !(*_it)->ownsSocket())
+				{
+					(*_it)->retire();
+					return;
+				}
+			}
+		}
+
+		void PoolController::adjust()
+		{
+			unsigned long load = 0;
+			size_t live = reap(load);
+			if (!live)
+				return;
+
+			unsigned long long wait = 0;
+			size_t pending = 0;
+			EventEnginePtr engine = m_app.engine();
+			if (engine)
+			{
+				wait = engine->scheduler().sampleWait();
+				pending = engine->scheduler().pending();
+			}
+
+			if (load >= HIGH_LOAD || wait >= MAX_QUEUE_WAIT || pending >= live)
+			{
+				m_idleSamples = 0;
+				if (live < m_app.m_maxThreads)
+					grow(live);
+				return;
+			}
+
+			if (load > LOW_LOAD || live <= m_app.m_minThreads)
+			{
+				m_idleSamples = 0;
+				return;
+			}
+
+			if (++m_idleSamples < IDLE_SAMPLES)
+				return;
+
+			m_idleSamples = 0;
+			shrink();
+		}
+	}
+}
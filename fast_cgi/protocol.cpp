@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/protocol.hpp>
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		namespace protocol
+		{
+			ReadResult readRecord(const char* data, size_t size, Record& record, size_t& consumed)
+			{
+				if (size < HEADER_SIZE)
+					return PARTIAL;
+
+				const unsigned char* header = (const unsigned char*)data;
+				if (header[0] != VERSION_1)
+					return MALFORMED;
+
+				size_t length = (size_t)header[4] << 8 | header[5];
+				size_t total = HEADER_SIZE + length + header[6];
+				if (size < total)
+					return PARTIAL;
+
+				record.type = header[1];
+				record.id = (unsigned short)(header[2] << 8 | header[3]);
+				record.content = data + HEADER_SIZE;
+				record.length = length;
+				consumed = total;
+				return RECORD;
+			}
+
+			static inline bool nvLength(const unsigned char*& c, const unsigned char* end, size_t& length)
+			{
+				if (c >= end)
+					return false;
+				if (!(*c & 0x80))
+				{
+					length = *c++;
+					return true;
+				}
+				if (end - c < 4)
+					return false;
+				length = (size_t)(c[0] & 0x7F) << 24 | (size_t)c[1] << 16 | (size_t)c[2] << 8 | c[3];
+				c += 4;
+				return true;
+			}
+
+			static inline void putLength(std::string& out, size_t length)
+			{
+				if (length < 0x80)
+				{
+					out.push_back((char)length);
+					return;
+				}
+				out.push_back((char)(0x80 | (length >> 24)));
+				out.push_back((char)(length >> 16));
+				out.push_back((char)(length >> 8));
+				out.push_back((char)length);
+			}
+
+			bool decodeParams(std::string& params, std::vector<const char*>& envp)
+			{
+				char* base = &params[0];
+				const unsigned char* c = (const unsigned char*)base;
+				const unsigned char* end = c + params.size();
+				size_t out = 0;
+
+				// offsets first; the pointers are only good once the
+				// string is no longer resized
+				std::vector<size_t> offsets;
+				while (c < end)
+				{
+					size_t nameLength, valueLength;
+					if (!nvLength(c, end, nameLength) || !nvLength(c, end, valueLength) || (size_t)(end - c) < nameLength + valueLength)
+						return false;
+
+					// two length bytes at least were read, and only two
+					// are written ('=' and NUL), so the entry fits
+					const char* name = (const char*)c;
+					offsets.push_back(out);
+					memmove(base + out, name, nameLength);
+					out += nameLength;
+					base[out++] = '=';
+					memmove(base + out, name + nameLength, valueLength);
+					out += valueLength;
+					base[out++] = 0;
+					c += nameLength + valueLength;
+				}
+
+				params.resize(out);
+				base = &params[0];
+
+				envp.clear();
+				envp.reserve(offsets.size() + 1);
+				for (auto&& offset : offsets)
+					envp.push_back(base + offset);
+				envp.push_back(nullptr);
+				return true;
+			}
+
+			bool nextName(const char*& data, const char* end, const char*& name, size_t& length)
+			{
+				const unsigned char* c = (const unsigned char*)data;
+				const unsigned char* stop = (const unsigned char*)end;
+				size_t valueLength;
+				if (!nvLength(c, stop, length) || !nvLength(c, stop, valueLength) || (size_t)(stop - c) < length + valueLength)
+					return false;
+
+				name = (const char*)c;
+				data = name + length + valueLength;
+				return true;
+			}
+
+			void appendNameValue(std::string& out, const char* name, size_t nameLength, const std::string& value)
+			{
+				putLength(out, nameLength);
+				putLength(out, value.length());
+				out.append(name, nameLength);
+				out.append(value);
+			}
+		}
+	}
+}
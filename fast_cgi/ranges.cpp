@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/ranges.hpp>
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace FastCGI
+{
+	bool MemorySource::send(ResponseBuffer& out, unsigned long long offset, unsigned long long length)
+	{
+		if (offset > m_size || length > m_size - offset)
+			return false;
+		out.append(m_data + offset, (size_t)length);
+		return true;
+	}
+
+#ifdef _WIN32
+	FileSource::FileSource()
+		: m_file(nullptr)
+		, m_size(0)
+	{
+	}
+
+	bool FileSource::isOpen() const { return !!m_file; }
+
+	bool FileSource::open(const std::string& path)
+	{
+		close();
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4996)
+#endif
+		m_file = fopen(path.c_str(), "rb");
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+		if (!m_file)
+			return false;
+
+		_fseeki64(m_file, 0, SEEK_END);
+		m_size = (unsigned long long)_ftelli64(m_file);
+		return true;
+	}
+
+	void FileSource::close()
+	{
+		if (m_file)
+			fclose(m_file);
+		m_file = nullptr;
+		m_size = 0;
+	}
+
+	bool FileSource::send(ResponseBuffer& out, unsigned long long offset, unsigned long long length)
+	{
+		if (!m_file || offset > m_size || length > m_size - offset)
+			return false;
+
+		if (_fseeki64(m_file, (long long)offset, SEEK_SET))
+			return false;
+
+		char buffer[READ_CHUNK_SIZE];
+		while (length)
+		{
+			size_t chunk = length < sizeof(buffer) ? (size_t)length : sizeof(buffer);
+			size_t read = fread(buffer, 1, chunk, m_file);
+			if (!read)
+				return false;
+			out.append(buffer, read);
+			length -= read;
+		}
+		return true;
+	}
+#else
+	FileSource::FileSource()
+		: m_fd(-1)
+		, m_size(0)
+	{
+	}
+
+	bool FileSource::isOpen() const { return m_fd >= 0; }
+
+	bool FileSource::open(const std::string& path)
+	{
+		close();
+		m_fd = ::open(path.c_str(), O_RDONLY);
+		if (m_fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(m_fd, &st) || !S_ISREG(st.st_mode))
+		{
+			close();
+			return false;
+		}
+		m_size = (unsigned long long)st.st_size;
+		return true;
+	}
+
+	void FileSource::close()
+	{
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_fd = -1;
+		m_size = 0;
+	}
+
+	bool FileSource::send(ResponseBuffer& out, unsigned long long offset, unsigned long long length)
+	{
+		if (m_fd < 0 || offset > m_size || length > m_size - offset)
+			return false;
+
+		// not mapped: a file truncated while it is sent would end
+		// the process with SIGBUS; a short read only fails the request
+		char buffer[READ_CHUNK_SIZE];
+		while (length)
+		{
+			size_t chunk = length < sizeof(buffer) ? (size_t)length : sizeof(buffer);
+			ssize_t read = pread(m_fd, buffer, chunk, (off_t)offset);
+			if (read <= 0)
+				return false;
+			out.append(buffer, (size_t)read);
+			offset += read;
+			length -= read;
+		}
+		return true;
+	}
+#endif
+
+	FileSource::~FileSource()
+	{
+		close();
+	}
+
+	namespace impl
+	{
+		static inline void skipws(const char*& c)
+		{
+			while (*c == ' ' || *c == '\t') ++c;
+		}
+
+		static inline bool number(const char*& c, unsigned long long& value)
+		{
+			if (*c < '0' || *c > '9')
+				return false;
+
+			value = 0;
+			while (*c >= '0' && *c <= '9')
+			{
+				unsigned digit = *c - '0';
+				if (value > (ULLONG_MAX - digit) / 10)
+					return false; // left on the digit, so the range is refused
+				value = value * 10 + digit;
+				++c;
+			}
+			return true;
+		}
+
+		ByteRanges::Result ByteRanges::parse(const char* header, unsigned long long size)
+		{
+			m_ranges.clear();
+			if (!header || strncmp(header, "bytes=", 6))
+				return WHOLE;
+
+			bool any = false;
+			const char* c = header + 6;
+			while (true)
+			{
+				skipws(c);
+				if (*c == ',') // empty list elements are allowed
+				{
+					++c;
+					continue;
+				}
+				if (!*c)
+					break;
+
+				unsigned long long first = 0, last = 0;
+				bool hasFirst = number(c, first);
+				skipws(c);
+				if (*c++ != '-')
+					return WHOLE;
+				skipws(c);
+				bool hasLast = number(c, last);
+				skipws(c);
+				if (*c && *c != ',')
+					return WHOLE;
+
+				if (!hasFirst && !hasLast)
+					return WHOLE;
+				if (hasFirst && hasLast && last < first)
+					return WHOLE;
+				any = true;
+
+				if (!hasFirst)
+				{
+					// the last "last" bytes
+					if (!last || !size)
+						continue;
+					first = last < size ? size - last : 0;
+					last = size - 1;
+				}
+				else
+				{
+					if (first >= size)
+						continue;
+					if (!hasLast || last >= size)
+						last = size - 1;
+				}
+
+				if (m_ranges.size() >= 2 * MAX_RANGES)
+				{
+					m_ranges.clear();
+					return WHOLE;
+				}
+				m_ranges.push_back({ first, last });
+			}
+
+			if (!any)
+				return WHOLE;
+			if (m_ranges.empty())
+				return UNSATISFIABLE;
+
+			std::sort(m_ranges.begin(), m_ranges.end(), [](const ByteRange& lhs, const ByteRange& rhs) { return lhs.first < rhs.first; });
+
+			size_t out = 0;
+			for (size_t i = 1; i < m_ranges.size(); ++i)
+			{
+				if (m_ranges[i].first <= m_ranges[out].last + 1)
+				{
+					if (m_ranges[i].last > m_ranges[out].last)
+						m_ranges[out].last = m_ranges[i].last;
+				}
+				else
+					m_ranges[++out] = m_ranges[i];
+			}
+			m_ranges.resize(out + 1);
+
+			if (m_ranges.size() > MAX_RANGES)
+			{
+				m_ranges.clear();
+				return WHOLE;
+			}
+			return PARTIAL;
+		}
+	}
+}
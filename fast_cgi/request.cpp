@@ -27,14 +27,19 @@
 #include <fast_cgi/request.hpp>
 #include <fast_cgi/session.hpp>
 #include <fast_cgi/thread.hpp>
+#include <fast_cgi/urlencoded.hpp>
+#include <fast_cgi/compression.hpp>
+#include "scan.hpp"
+#include "text.hpp"
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <wiki/wiki.hpp>
 #include <mail/mail.hpp>
 #include <mail/wiki_mailer.hpp>
 
-#define MAX_FORM_BUFFER 10240
+#define INPUT_CHUNK_SIZE 16384
 
 FastCGI::static_resources_t static_web{};
 
@@ -143,123 +148,501 @@ namespace FastCGI
 	Request::Request(Thread& thread)
 		: m_thread(thread)
 		, m_headersSent(false)
+		, m_headersWritten(false)
+		, m_compressionAllowed(true)
+		, m_compressing(false)
+		, m_flushAfterHead(false)
+		, m_autoETag(false)
+		, m_headScanned(0)
+		, m_sink(*this)
+		, m_headers(allocator())
+		, m_respCookies(ResponseCookies::key_compare(), allocator())
+		, m_reqCookies(RequestCookies::key_compare(), allocator())
+		, m_reqVars(RequestVariables::key_compare(), allocator())
 		, m_alreadyReadSomething(false)
-		, m_backend(thread.m_backend->newRequestBackend())
+		, m_inputUnknown(false)
+		, m_bytesRead(0)
+		, m_cookiesUnpacked(false)
+		, m_bodyUnpacked(false)
+		, m_queryUnpacked(false)
+		, m_formRejected(0)
+		, m_params(nullptr)
+		, m_paramsMask(0)
+		, m_uploadsAllowed(false)
+		, m_backend(&thread.m_backend->requestBackend())
 	{
-		unpackCookies();
-		unpackVariables();
+		m_thread.m_output.attach(&m_sink);
 	}
 
 	Request::~Request()
 	{
 		readAll();
-		printHeaders();
+		commitHeaders();
+		m_thread.m_output.detach();
 	}
 
-#define WS() do { while (isspace((unsigned char)*c) && c < end) ++c; } while(0)
-#define LOOK_FOR(ch) do { while (!isspace((unsigned char)*c) && *c != (ch) && c < end) ++c; } while(0)
-#define LOOK_FOR2(ch1, ch2) do { while (!isspace((unsigned char)*c) && *c != (ch1) && *c != (ch2) && c < end) ++c; } while(0)
-#define IS(ch) (c < end && *c == (ch))
+	// FNV-1a
+	static inline size_t paramHash(const char* name, size_t length)
+	{
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < length; ++i)
+		{
+			hash ^= (unsigned char)name[i];
+			hash *= 16777619u;
+		}
+		return hash;
+	}
 
-	void Request::unpackCookies()
+	void Request::indexParams() const
 	{
+		const char * const* env = envp();
+		size_t count = 0;
+		if (env)
+		{
+			while (env[count])
+				++count;
+		}
+
+		// load factor of at most 1/2
+		size_t size = 16;
+		while (size < count * 2)
+			size <<= 1;
+
+		m_params = static_cast<ParamSlot*>(m_thread.m_arena.allocate(size * sizeof(ParamSlot), alignof(ParamSlot)));
+		memset(m_params, 0, size * sizeof(ParamSlot));
+		m_paramsMask = size - 1;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const char* eq = strchr(env[i], '=');
+			if (!eq)
+				continue;
+
+			size_t length = eq - env[i];
+			size_t pos = paramHash(env[i], length) & m_paramsMask;
+			while (m_params[pos].m_name)
+			{
+				// FCGX_GetParam returns the first one
+				if (m_params[pos].m_length == length && !memcmp(m_params[pos].m_name, env[i], length))
+					break;
+				pos = (pos + 1) & m_paramsMask;
+			}
+
+			if (m_params[pos].m_name)
+				continue;
+
+			m_params[pos].m_name = env[i];
+			m_params[pos].m_length = length;
+			m_params[pos].m_value = eq + 1;
+		}
+	}
+
+	param_t Request::getParam(const char* name) const
+	{
+		if (!name)
+			return nullptr;
+
+		if (!m_params)
+			indexParams();
+
+		size_t length = strlen(name);
+		size_t pos = paramHash(name, length) & m_paramsMask;
+		while (m_params[pos].m_name)
+		{
+			if (m_params[pos].m_length == length && !memcmp(m_params[pos].m_name, name, length))
+				return m_params[pos].m_value;
+			pos = (pos + 1) & m_paramsMask;
+		}
+		return nullptr;
+	}
+
+	param_view Request::unescaped(const char* data, size_t len) const
+	{
+		if (!impl::scan::escaped(data, len))
+			return param_view(data, len);
+		return decoded(data, len);
+	}
+
+	param_view Request::decoded(const char* data, size_t len) const
+	{
+		char* buffer = arenaBuffer(len + 1);
+		size_t size = impl::scan::decode(data, len, buffer);
+		buffer[size] = 0;
+		return param_view(buffer, size);
+	}
+
+	param_view Request::arenaCopy(const char* data, size_t len) const
+	{
+		char* buffer = arenaBuffer(len + 1);
+		memcpy(buffer, data, len);
+		buffer[len] = 0;
+		return param_view(buffer, len);
+	}
+
+	param_view Request::value(const RequestValue& value) const
+	{
+		if (value.m_escaped)
+		{
+			value.m_value = decoded(value.m_value.data(), value.m_value.size());
+			value.m_cstr = value.m_value.data(); // decoded values are always terminated
+			value.m_escaped = false;
+		}
+		return value.m_value;
+	}
+
+	param_t Request::c_str(const RequestValue& value) const
+	{
+		if (value.m_cstr)
+			return value.m_cstr;
+
+		param_view view = this->value(value);
+		if (view.data()[view.size()] == 0)
+		{
+			// the last value in the query/header is already terminated
+			value.m_cstr = view.data();
+			return value.m_cstr;
+		}
+
+		char* buffer = arenaBuffer(view.size() + 1);
+		memcpy(buffer, view.data(), view.size());
+		buffer[view.size()] = 0;
+		value.m_cstr = buffer;
+		return value.m_cstr;
+	}
+
+	void Request::unpackCookies() const
+	{
+		m_cookiesUnpacked = true;
+
 		param_t HTTP_COOKIE = getParam("HTTP_COOKIE");
 		if (!HTTP_COOKIE || !*HTTP_COOKIE)
 			return;
 
+		const Application* app = m_thread.app();
+
 		param_t end = HTTP_COOKIE + strlen(HTTP_COOKIE);
 		param_t c = HTTP_COOKIE;
 		while (c < end)
 		{
-			WS();
+			param_t cookie_end = impl::scan::find_cookie_end(c, end);
+			param_t eq = (param_t)memchr(c, '=', cookie_end - c);
+			if (!eq)
+			{
+				c = cookie_end + 1;
+				continue;
+			}
+
 			param_t name_start = c;
-			LOOK_FOR('=');
-			std::string name(name_start, c);
-			WS();
-			if (!IS('=')) break;
-			++c;
-			WS();
-			if (IS('"'))
+			param_t name_end = eq;
+			param_t value_start = eq + 1;
+			param_t value_end = cookie_end;
+			impl::text::trim(name_start, name_end);
+			impl::text::trim(value_start, value_end);
+
+			param_view name(name_start, name_end - name_start);
+			bool wanted = !name.empty() && name[0] != '$' &&
+				(!app || app->isCookieWanted(name.data(), name.size()));
+
+			if (value_start < value_end && *value_start == '"')
 			{
+				// the quoted string may hold the delimiters itself
 				const char* quot_end = nullptr;
-				std::string value = url::quot_parse(c + 1, end - c - 1, &quot_end);
-				if (quot_end && *quot_end)
-					c = quot_end + 1;
-				else
+				std::string value = url::quot_parse(value_start + 1, end - value_start - 1, &quot_end);
+				if (!quot_end || !*quot_end)
 					break;
-				if (name[0] != '$')
-					m_reqCookies[name] = value;
-			}
-			else
-			{
-				param_t value_start = c;
-				LOOK_FOR2(';', ',');
-				if (name[0] != '$')
-					m_reqCookies[name] = std::string(value_start, c);
+				cookie_end = impl::scan::find_cookie_end(quot_end + 1, end);
+				if (wanted)
+				{
+					// quoted values are rare enough to decode right away
+					char* buffer = arenaBuffer(value.length() + 1);
+					memcpy(buffer, value.c_str(), value.length() + 1);
+					m_reqCookies[name] = RequestValue(param_view(buffer, value.length()), false);
+				}
 			}
-			WS();
-			if (c >= end || (*c != ';' && *c != ',')) break;
-			++c;
-		};
+			else if (wanted)
+				m_reqCookies[name] = RequestValue(param_view(value_start, value_end - value_start), false);
+
+			c = cookie_end + 1;
+		}
 	}
 
-	void Request::unpackVariables(const char* data, size_t len)
+	struct VariableTarget : impl::UrlencodedHandler
 	{
-		const char* c = data;
-		const char* end = c + len;
-		while (c < end)
-		{
-			WS();
-			const char* name_start = c;
-			LOOK_FOR2('=', '&');
-			std::string name = url::decode(name_start, c - name_start);
-			WS();
+		const Request& req;
+		bool copy; // the data will not outlive the parser
 
-			if (IS('='))
-			{
-				++c;
-				WS();
-				const char* value_start = c;
-				LOOK_FOR('&');
-				m_reqVars[name] = url::decode(value_start, c - value_start);
-				WS();
-			}
-			else
-				m_reqVars[name].erase();
+		VariableTarget(const Request& req, bool copy) : req(req), copy(copy) {}
+
+		void onVariable(const char* name, size_t nameLength, bool nameEscaped,
+			const char* value, size_t valueLength, bool valueEscaped) override
+		{
+			req.addEncodedVariable(name, nameLength, nameEscaped, value, valueLength, valueEscaped, copy);
+		}
+	};
 
-			if (!IS('&')) break;
+	void Request::addEncodedVariable(const char* name, size_t nameLength, bool nameEscaped,
+		const char* value, size_t valueLength, bool valueEscaped, bool copy) const
+	{
+		param_view key(name, nameLength);
+		if (nameEscaped)
+			key = decoded(name, nameLength);
+		else if (copy)
+			key = arenaCopy(name, nameLength);
 
-			++c;
+		if (!value)
+		{
+			m_reqVars[key] = RequestValue(param_view("", 0), false);
+			return;
 		}
+
+		param_view val(value, valueLength);
+		if (copy)
+			val = arenaCopy(value, valueLength);
+		m_reqVars[key] = RequestValue(val, valueEscaped);
+	}
+
+	void Request::unpackVariables(const char* data, size_t len) const
+	{
+		VariableTarget target(*this, false);
+		impl::UrlencodedParser(target).parse(data, len);
 	}
 
-	void Request::unpackVariables()
+	void Request::unpackBody()
 	{
+		m_bodyUnpacked = true;
+
+		// the handler has chosen to read the body by itself
+		if (m_alreadyReadSomething)
+			return;
+
 		param_t CONTENT_TYPE = getParam("CONTENT_TYPE");
 		param_t semi = CONTENT_TYPE ? strchr(CONTENT_TYPE, ';') : nullptr;
 		if (CONTENT_TYPE && !strncmp(CONTENT_TYPE, "application/x-www-form-urlencoded", semi - CONTENT_TYPE))
 		{
+			Application& app = this->app();
+			unsigned long long maxSize = app.getMaxFormSize();
+
 			long long length = calcStreamSize();
-			if (length != -1)
+			if (length > 0 && (unsigned long long)length > maxSize)
 			{
-				if (length > MAX_FORM_BUFFER)
-					length = MAX_FORM_BUFFER;
+				rejectForm();
+				return;
+			}
+
+			// tokens are taken straight from the input buffer, only
+			// the variables themselves are copied to the arena
+			VariableTarget target(*this, true);
+			impl::UrlencodedParser parser(target, app.getMaxFormFields());
 
-				char * buffer = new (std::nothrow) char[(size_t)length];
-				if (buffer)
+			char buffer[INPUT_CHUNK_SIZE];
+			unsigned long long total = 0;
+			std::streamsize got;
+			while ((got = read(buffer, sizeof(buffer))) > 0)
+			{
+				total += got;
+				if (total > maxSize || !parser.feed(buffer, (size_t)got))
 				{
-					if (read(buffer, length) == length)
-						unpackVariables(buffer, (size_t)length);
-					delete [] buffer;
+					rejectForm();
+					return;
 				}
 			}
+
+			if (!parser.finish())
+				rejectForm();
 		}
 		else if (CONTENT_TYPE && !strncmp(CONTENT_TYPE, "multipart/form-data", semi - CONTENT_TYPE))
 		{
-			// TODO: add support?
-			readAll();
+			// not yet known, if the handler wants it; if it never says so,
+			// ensureInputWasRead() will drop the body
+			if (!m_uploadsAllowed)
+			{
+				m_bodyUnpacked = false;
+				return;
+			}
+			unpackMultipart(CONTENT_TYPE);
+		}
+	}
+
+	void Request::rejectForm(int status)
+	{
+		// nothing of a form cut short is to be trusted; the query
+		// string is parsed again, as it may have been dropped with it
+		m_formRejected = status;
+		m_reqVars.clear();
+		m_queryUnpacked = false;
+		m_uploads.clear(); // removes the temporary files
+	}
+
+	void Request::answerForm()
+	{
+		int status = m_formRejected;
+		m_formRejected = 0;
+		readAll();
+		if (status == 400)
+			on400("Malformed form data");
+		on413();
+	}
+
+	void Request::answerRejectedForm()
+	{
+		// the handler never started the response, e.g. it only redirected
+		if (m_formRejected && !m_headersSent)
+			answerForm();
+	}
+
+	struct RequestMultipart : impl::MultipartHandler
+	{
+		Request& req;
+		UploadSinkPtr sink;
+		std::shared_ptr<impl::TempFileSink> temp;
+		UploadedFilePtr current;
+
+		// the same limits as for the url-encoded forms, the files
+		// have a limit of their own
+		unsigned long long fieldBytes;
+		unsigned long long fileBytes;
+		size_t fields;
+		bool tooLarge;
+
+		explicit RequestMultipart(Request& req) : req(req), fieldBytes(0), fileBytes(0), fields(0), tooLarge(false) {}
+
+		bool limit(bool over)
+		{
+			if (over)
+				tooLarge = true;
+			return !over;
+		}
+
+		bool field()
+		{
+			size_t max = req.app().getMaxFormFields();
+			return limit(max && ++fields > max);
+		}
+		~RequestMultipart()
+		{
+			// the body was cut in the middle of a file
+			if (current)
+			{
+				sink->close();
+				req.m_uploads.remove(current);
+			}
+		}
+
+		bool onField(const std::string& name, const std::string& value) override
+		{
+			fieldBytes += name.length() + value.length();
+			if (!field() || !limit(fieldBytes > req.app().getMaxFormSize()))
+				return false;
+
+			req.addVariable(name, value);
+			return true;
+		}
+
+		bool onFileOpen(const UploadInfo& info) override
+		{
+			if (!field())
+				return false;
+
+			sink = req.m_uploadSink;
+			if (!sink)
+			{
+				temp = std::make_shared<impl::TempFileSink>();
+				sink = temp;
+			}
+
+			if (!sink->open(info))
+				return false;
+
+			current = std::make_shared<UploadedFile>(info, temp ? temp->path() : std::string());
+			req.m_uploads.push_back(current);
+			return true;
+		}
+
+		bool onFileData(const char* data, size_t size) override
+		{
+			fileBytes += size;
+			if (!limit(fileBytes > req.app().getMaxUploadSize()))
+				return false;
+
+			current->grow(size);
+			return sink->write(data, size);
 		}
 
+		void onFileClose() override
+		{
+			sink->close();
+			sink.reset();
+			temp.reset();
+			current.reset();
+		}
+	};
+
+	void Request::unpackMultipart(const char* contentType)
+	{
+		std::string boundary = impl::MultipartParser::boundary(contentType);
+		if (boundary.empty())
+		{
+			rejectForm(400);
+			return;
+		}
+
+		Application& app = this->app();
+		unsigned long long maxSize = app.getMaxFormSize() + app.getMaxUploadSize();
+		long long length = calcStreamSize();
+		if (length > 0 && (unsigned long long)length > maxSize)
+		{
+			rejectForm();
+			return;
+		}
+
+		bool tooLarge = false, complete = false;
+		{
+			RequestMultipart handler(*this);
+			impl::MultipartParser parser(boundary, handler, (size_t)std::min<unsigned long long>(app.getMaxFormSize(), SIZE_MAX));
+
+			char buffer[INPUT_CHUNK_SIZE];
+			unsigned long long total = 0;
+			std::streamsize got;
+			while (!parser.finished() && (got = read(buffer, sizeof(buffer))) > 0)
+			{
+				total += got;
+				if (total > maxSize)
+				{
+					tooLarge = true;
+					break;
+				}
+				if (!parser.feed(buffer, (size_t)got))
+					break;
+			}
+
+			complete = parser.finished();
+			tooLarge = tooLarge || handler.tooLarge || parser.tooLarge();
+		}
+
+		// a body cut short or broken is as bad as a too large one
+		if (!complete)
+		{
+			rejectForm(tooLarge ? 413 : 400);
+			return;
+		}
+
+		// epilogue
+		readAll();
+	}
+
+	void Request::addVariable(const std::string& name, const std::string& value) const
+	{
+		char* buffer = arenaBuffer(name.length() + value.length() + 2);
+		memcpy(buffer, name.c_str(), name.length() + 1);
+		char* value_buffer = buffer + name.length() + 1;
+		memcpy(value_buffer, value.c_str(), value.length() + 1);
+		m_reqVars[param_view(buffer, name.length())] = RequestValue(param_view(value_buffer, value.length()), false);
+	}
+
+	void Request::unpackQuery() const
+	{
+		m_queryUnpacked = true;
+
 		param_t QUERY_STRING = getParam("QUERY_STRING");
 		if (QUERY_STRING && *QUERY_STRING)
 		{
@@ -280,9 +663,21 @@ namespace FastCGI
 	void Request::readAll()
 	{
 		m_alreadyReadSomething = true;
-		// ignore() doesn't set the eof bit in some versions of glibc++
-		// so use gcount() instead of eof()...
-		do m_backend->cin().ignore(1024); while (m_backend->cin().gcount() == 1024);
+
+		// without the CONTENT_LENGTH, the stream is drained up to its end
+		param_t CONTENT_LENGTH = getParam("CONTENT_LENGTH");
+		char* end = nullptr;
+		long long length = CONTENT_LENGTH && *CONTENT_LENGTH ? strtoll(CONTENT_LENGTH, &end, 10) : -1;
+		if (!end || *end || length < 0 || m_inputUnknown)
+			length = -1;
+		else
+		{
+			length -= m_bytesRead;
+			if (length <= 0)
+				return;
+		}
+
+		m_bytesRead += m_backend->skip(length);
 	}
 
 	long long Request::calcStreamSize()
@@ -304,75 +699,277 @@ namespace FastCGI
 
 	void Request::ensureInputWasRead()
 	{
-		if (m_alreadyReadSomething)
-			return;
-		readAll();
+		// the form may still be needed after the output has started,
+		// so it has to be parsed before the rest of the input is lost
+		if (!m_alreadyReadSomething && !m_bodyUnpacked)
+			unpackBody();
+
+		// the getters only leave the rejected form out; the answer
+		// is given here, once the handler starts the response
+		if (m_formRejected)
+			answerForm();
+
+		if (!m_alreadyReadSomething)
+			readAll();
 	}
 
-	void Request::buildCookieHeader()
+	const std::string& Request::cookieSuffix()
 	{
-		std::string cookies;
-
-		std::string domAndPath = "; Version=1";
 		param_t SERVER_NAME = getParam("SERVER_NAME");
-		if (SERVER_NAME && *SERVER_NAME)
+		if (!SERVER_NAME)
+			SERVER_NAME = "";
+
+		std::string& suffix = m_thread.m_cookieSuffix;
+		if (!suffix.empty() && m_thread.m_cookieServer == SERVER_NAME)
+			return suffix;
+
+		m_thread.m_cookieServer = SERVER_NAME;
+		suffix = "; Version=1";
+		if (*SERVER_NAME)
 		{
-			domAndPath += "; Domain=";
-			domAndPath += SERVER_NAME;
+			suffix += "; Domain=";
+			suffix += SERVER_NAME;
 		}
-		domAndPath += "; Path=/; HttpOnly";
+		suffix += "; Path=/; HttpOnly";
+		return suffix;
+	}
+
+	void Request::buildCookieHeader()
+	{
+		if (m_respCookies.empty())
+			return;
+
+		std::string cookies;
+		const std::string& domAndPath = cookieSuffix();
 
 		bool first = true;
 		for (auto&& cookie: m_respCookies)
 		{
 			if (first) first = false;
 			else cookies += ", ";
-			cookies += url::encode(cookie.second.m_name) + "=";
-			if (url::isToken(cookie.second.m_value))
-				cookies += cookie.second.m_value;
+			std::string value(cookie.second.m_value.begin(), cookie.second.m_value.end());
+			cookies += url::encode(std::string(cookie.second.m_name.begin(), cookie.second.m_name.end())) + "=";
+			if (url::isToken(value))
+				cookies += value;
 			else
-				cookies += "\"" + url::quot_escape(cookie.second.m_value) + "\"";
+				cookies += "\"" + url::quot_escape(value) + "\"";
 			cookies += domAndPath;
 
 			if (cookie.second.m_expire != 0)
 			{
-				char buffer[256];
-				tyme::tm_t tm = tyme::gmtime(cookie.second.m_expire);
-				tyme::strftime(buffer, "%a, %d-%b-%Y %H:%M:%S GMT", tm );
+				HttpDate& expires = m_thread.m_cookieExpires;
+				const char* date = expires.format(cookie.second.m_expire);
 				cookies += "; Expires=";
-				cookies += buffer;
+				cookies.append(date, expires.length());
 			}
 		};
 
 		if (!cookies.empty())
-			m_headers["set-cookie"] = "Set-Cookie: " + cookies;
+			m_headers.set(HEADER_SET_COOKIE, cookies.data(), cookies.length());
 	}
 
-	void Request::printHeaders()
+	void Request::commitHeaders()
 	{
 		if (m_headersSent)
 			return;
 
 		m_headersSent = true;
-		if (m_headers.find("content-type") == m_headers.end())
-			m_headers["content-type"] = "Content-Type: text/html; charset=utf-8";
-
 		buildCookieHeader();
+	}
+
+	void Request::startCompression(size_t size, bool last)
+	{
+		if (!m_compressionAllowed || (last && !size))
+			return;
+
+		param_view status = m_headers.get(HEADER_STATUS);
+		if (!status.null() && (status.size() < 3 || memcmp(status.data(), "200", 3)))
+			return;
+
+		// already encoded, or a part of something larger
+		if (m_headers.has(HEADER_CONTENT_ENCODING) || m_headers.has(HEADER_CONTENT_RANGE))
+			return;
+
+		param_view contentType = m_headers.get(HEADER_CONTENT_TYPE);
+		if (!contentType.null() && !impl::Compressor::compressible(contentType))
+			return;
+
+		// from now on, the response depends on the Accept-Encoding
+		param_view vary = m_headers.get(HEADER_VARY);
+		if (vary.null())
+			m_headers.set(HEADER_VARY, "Accept-Encoding");
+		else
+		{
+			std::string value = vary.str() + ", Accept-Encoding";
+			m_headers.set(HEADER_VARY, value.c_str(), value.length());
+		}
+
+		Application* app = m_thread.app();
+		if (last && app && size < app->getCompressionThreshold())
+			return;
+
+		impl::Compressor::Encoding encoding = impl::Compressor::negotiate(getParam("HTTP_ACCEPT_ENCODING"));
+		if (!m_thread.m_compressor.start(encoding))
+			return;
+
+		m_headers.set(HEADER_CONTENT_ENCODING, impl::Compressor::name(encoding));
+		m_headers.remove(HEADER_CONTENT_LENGTH);
+		m_compressing = true;
+
+		// the compressed bytes are not the ones the strong ETag promised
+		param_view etag = m_headers.get(HEADER_ETAG);
+		if (!etag.null() && (etag.size() < 2 || memcmp(etag.data(), "W/", 2)))
+		{
+			std::string weak = "W/" + etag.str();
+			m_headers.set(HEADER_ETAG, weak.c_str(), weak.length());
+		}
+	}
+
+	static inline param_view opaqueTag(const char* begin, const char* end)
+	{
+		if (end - begin > 2 && begin[0] == 'W' && begin[1] == '/')
+			begin += 2;
+		return param_view(begin, end - begin);
+	}
+
+	// If-None-Match uses the weak comparison
+	bool Request::notModified(const param_view& etag)
+	{
+		param_t HTTP_IF_NONE_MATCH = getParam("HTTP_IF_NONE_MATCH");
+		if (!HTTP_IF_NONE_MATCH || !*HTTP_IF_NONE_MATCH)
+			return false;
+
+		param_view tag = opaqueTag(etag.begin(), etag.end());
+		const char* c = HTTP_IF_NONE_MATCH;
+		while (*c)
+		{
+			while (*c == ' ' || *c == '\t' || *c == ',') ++c;
+			const char* start = c;
+			while (*c && *c != ',') ++c;
+			const char* end = c;
+			while (end > start && (end[-1] == ' ' || end[-1] == '\t')) --end;
+
+			if (end - start == 1 && *start == '*')
+				return true;
+			if (start < end && opaqueTag(start, end) == tag)
+				return true;
+		}
+		return false;
+	}
+
+	bool Request::autoETag(const char* data, size_t size)
+	{
+		param_view status = m_headers.get(HEADER_STATUS);
+		if (!status.null() && (status.size() < 3 || memcmp(status.data(), "200", 3)))
+			return false;
+
+		unsigned char digest[MD5_DIGEST_LENGTH];
+		MD5((const unsigned char*)data, size, digest);
+
+		static const char hex[] = "0123456789abcdef";
+		char etag[MD5_DIGEST_LENGTH * 2 + 3];
+		char* out = etag;
+		*out++ = '"';
+		for (size_t i = 0; i < MD5_DIGEST_LENGTH; ++i)
+		{
+			*out++ = hex[digest[i] >> 4];
+			*out++ = hex[digest[i] & 0xF];
+		}
+		*out++ = '"';
+		*out = 0;
+
+		m_headers.set(HEADER_ETAG, etag, out - etag);
+		if (!notModified(param_view(etag, out - etag)))
+			return false;
+
+		m_headers.set(HEADER_STATUS, "304 Not Modified");
+		m_headers.remove(HEADER_CONTENT_LENGTH);
+		return true;
+	}
+
+	void Request::writeHeaders()
+	{
+		static const char defaultContentType[] = "Content-Type: text/html; charset=utf-8\r\n";
+		ArenaString block(allocator());
+		block.reserve(1024);
 
 #if DEBUG_CGI
 		bool hasIcicle = !m_icicle.empty();
 #endif
 
+		if (!m_headers.has(HEADER_CONTENT_TYPE))
+		{
+			block.append(defaultContentType, sizeof(defaultContentType) - 1);
+#if DEBUG_CGI
+			if (hasIcicle)
+				app().reportHeader(std::string(defaultContentType, sizeof(defaultContentType) - 3), m_icicle);
+#endif
+		}
+
 		for (auto&& header: m_headers)
 		{
-			*this << header.second << "\r\n";
+			block.append(header.line().data(), header.line().size()).append("\r\n", 2);
 #if DEBUG_CGI
 			if (hasIcicle)
-				app().reportHeader(header.second, m_icicle);
+				app().reportHeader(header.line().str(), m_icicle);
 #endif
 		};
 
-		*this << "\r\n";
+		block.append("\r\n", 2);
+		m_backend->write(block.data(), block.length());
+	}
+
+	void Request::sendOutput(const char* data, size_t size, bool last)
+	{
+		if (!m_headersWritten)
+		{
+			m_headersWritten = true;
+
+			// the whole body is known only, if nothing was flushed before
+			if (m_autoETag && last && autoETag(data, size))
+			{
+				writeHeaders();
+				return;
+			}
+
+			startCompression(size, last);
+			writeHeaders();
+		}
+
+		if (m_compressing)
+			m_thread.m_compressor.write(data, size, last, *m_backend);
+		else if (size)
+			m_backend->write(data, size);
+	}
+
+	void Request::flush()
+	{
+		ResponseBuffer& out = output();
+		out.flush();
+		m_backend->flush();
+	}
+
+	void Request::lookForHead()
+	{
+		static const char tag[] = "</head>";
+		static const size_t length = sizeof(tag) - 1;
+
+		// m_headScanned counts from the beginning of the response, the
+		// buffer only has what came after the last flush; a tag split
+		// between two fragments is found by going back a bit
+		ResponseBuffer& out = m_thread.m_output;
+		size_t from = m_headScanned > length - 1 ? m_headScanned - (length - 1) : 0;
+		if (from < out.flushed())
+			from = out.flushed();
+
+		const char* begin = out.data() + (from - out.flushed());
+		const char* end = out.data() + out.size();
+		m_headScanned = out.flushed() + out.size();
+		if (std::search(begin, end, tag, tag + length) == end)
+			return;
+
+		m_flushAfterHead = false;
+		flush();
 	}
 
 	void Request::setHeader(const std::string& name, const std::string& value)
@@ -384,15 +981,28 @@ namespace FastCGI
 #endif
 			return;
 		}
-		std::string v(name);
-		v += ": ";
-		v += value;
-		std::string n(name);
-		std::transform(n.begin(), n.end(), n.begin(), ::tolower);
-		if (n == "set-cookie" || n == "set-cookie2")
+		HeaderId id = ResponseHeaders::lookup(name.data(), name.length());
+		if (id == HEADER_SET_COOKIE)
 			return; //not that API, use setcookie
+		if (name.length() == 11 && name[10] == '2' && ResponseHeaders::lookup(name.data(), 10) == HEADER_SET_COOKIE)
+			return;
 
-		m_headers[n] = v;
+		m_headers.set(id, name.data(), name.length(), value.data(), value.length());
+	}
+
+	void Request::setHeader(HeaderId id, const char* value)
+	{
+		if (m_headersSent)
+		{
+#if DEBUG_CGI
+			*this << "<br/><b>Warning</b>: Cannot set header after sending data to the browser (" << ResponseHeaders::name(id) << ": " << value << ")<br/><br/>";
+#endif
+			return;
+		}
+		if (id == HEADER_SET_COOKIE)
+			return; //not that API, use setcookie
+
+		m_headers.set(id, value);
 	}
 
 	void Request::setCookie(const std::string& name, const std::string& value, tyme::time_t expire)
@@ -404,9 +1014,12 @@ namespace FastCGI
 #endif
 			return;
 		}
-		std::string n(name);
+		ArenaString n(name.data(), name.length(), allocator());
 		std::transform(n.begin(), n.end(), n.begin(), ::tolower);
-		m_respCookies[n] = Cookie(name, value, expire);
+		auto it = m_respCookies.find(n);
+		if (it != m_respCookies.end())
+			m_respCookies.erase(it);
+		m_respCookies.emplace(std::move(n), Cookie(name, value, expire, allocator()));
 	}
 
 	std::string Request::serverUri(const std::string& resource, bool withQuery)
@@ -443,7 +1056,7 @@ namespace FastCGI
 
 	void Request::redirectUrl(const std::string& url)
 	{
-		setHeader("Location", url);
+		setHeader(HEADER_LOCATION, url.c_str());
 		*this
 			<< "<h1>Redirection</h1>\n"
 			<< "<p>The app needs to be <a href='" << url << "'>here</a>.</p>"; 
@@ -452,42 +1065,175 @@ namespace FastCGI
 
 	void Request::onLastModified(tyme::time_t lastModified)
 	{
+		// RFC 7232, 3.3: with an If-None-Match, the date is not looked at;
+		// the ETag, if any, was already checked by onETag()
+		param_t HTTP_IF_NONE_MATCH = getParam("HTTP_IF_NONE_MATCH");
 		param_t HTTP_IF_MODIFIED_SINCE = getParam("HTTP_IF_MODIFIED_SINCE");
-		if (HTTP_IF_MODIFIED_SINCE && *HTTP_IF_MODIFIED_SINCE)
+		if (HTTP_IF_MODIFIED_SINCE && *HTTP_IF_MODIFIED_SINCE && !(HTTP_IF_NONE_MATCH && *HTTP_IF_NONE_MATCH))
 		{
 			tyme::tm_t tm;
 			tyme::scan(HTTP_IF_MODIFIED_SINCE, tm);
 			if (lastModified <= tyme::mktime(tm))
 			{
-				setHeader("Status", "304 Not Modified");
+				setHeader(HEADER_STATUS, "304 Not Modified");
 				die();
 			}
 		}
 
-		char lm[100];
-		tyme::strftime(lm, "%a, %d %b %Y %H:%M:%S GMT", tyme::gmtime(lastModified));
-		setHeader("Last-Modified", lm);
+		setHeader(HEADER_LAST_MODIFIED, m_thread.m_lastModified.format(lastModified));
 	}
 
-	void Request::on400(const char* reason)
+	void Request::onETag(const std::string& key)
+	{
+		std::string etag;
+		etag.reserve(key.length() + 2);
+		etag.push_back('"');
+		for (auto&& c : key)
+		{
+			// the opaque-tag may not have quotes, spaces or control characters
+			if (c == '"' || (unsigned char)c <= ' ' || c == 0x7F)
+				etag.push_back('_');
+			else
+				etag.push_back(c);
+		}
+		etag.push_back('"');
+
+		if (notModified(etag))
+		{
+			setHeader(HEADER_STATUS, "304 Not Modified");
+			setHeader(HEADER_ETAG, etag.c_str());
+			die();
+		}
+
+		setHeader(HEADER_ETAG, etag.c_str());
+	}
+
+	bool Request::rangeStillValid()
+	{
+		param_t HTTP_IF_RANGE = getParam("HTTP_IF_RANGE");
+		if (!HTTP_IF_RANGE || !*HTTP_IF_RANGE)
+			return true;
+
+		// a strong ETag, or the exact date; weak tags never match
+		param_view validator = m_headers.get(*HTTP_IF_RANGE == '"' ? HEADER_ETAG : HEADER_LAST_MODIFIED);
+		return !validator.null() && validator == param_view(HTTP_IF_RANGE);
+	}
+
+	bool Request::headRequest()
+	{
+		param_t REQUEST_METHOD = getParam("REQUEST_METHOD");
+		return REQUEST_METHOD && !strcmp(REQUEST_METHOD, "HEAD");
+	}
+
+	void Request::sendRanges(RangeSource& source)
+	{
+		unsigned long long size = source.size();
+		setHeader(HEADER_ACCEPT_RANGES, "bytes");
+
+		impl::ByteRanges ranges;
+		impl::ByteRanges::Result result = impl::ByteRanges::WHOLE;
+		if (rangeStillValid())
+			result = ranges.parse(getParam("HTTP_RANGE"), size);
+
+		char buffer[100];
+		if (result == impl::ByteRanges::UNSATISFIABLE)
+		{
+			sprintf(buffer, "bytes */%llu", size);
+			setHeader(HEADER_STATUS, "416 Requested Range Not Satisfiable");
+			setHeader(HEADER_CONTENT_RANGE, buffer);
+			setHeader(HEADER_CONTENT_LENGTH, "0");
+			die();
+		}
+
+		if (result == impl::ByteRanges::WHOLE || ranges.count() == 1)
+		{
+			unsigned long long first = 0, length = size;
+			if (result == impl::ByteRanges::PARTIAL)
+			{
+				first = ranges[0].first;
+				length = ranges[0].length();
+				sprintf(buffer, "bytes %llu-%llu/%llu", ranges[0].first, ranges[0].last, size);
+				setHeader(HEADER_STATUS, "206 Partial Content");
+				setHeader(HEADER_CONTENT_RANGE, buffer);
+			}
+
+			sprintf(buffer, "%llu", length);
+			setHeader(HEADER_CONTENT_LENGTH, buffer);
+			if (!length || headRequest())
+				return;
+
+			if (!source.send(output(), first, length))
+				die();
+			return;
+		}
+
+		char boundary[40];
+		sprintf(boundary, "%016llx%08x", (unsigned long long)tyme::now(), (unsigned)(uintptr_t)this);
+
+		param_view contentType = m_headers.get(HEADER_CONTENT_TYPE);
+		std::vector<std::string> parts;
+		parts.reserve(ranges.count());
+		unsigned long long length = 0;
+		for (auto&& range : ranges.ranges())
+		{
+			std::string part = "\r\n--";
+			part.append(boundary);
+			if (!contentType.null())
+			{
+				part.append("\r\nContent-Type: ");
+				part.append(contentType.data(), contentType.size());
+			}
+			sprintf(buffer, "\r\nContent-Range: bytes %llu-%llu/%llu\r\n\r\n", range.first, range.last, size);
+			part.append(buffer);
+
+			length += part.length() + range.length();
+			parts.push_back(std::move(part));
+		}
+
+		std::string closing = "\r\n--";
+		closing.append(boundary);
+		closing.append("--\r\n");
+		length += closing.length();
+
+		std::string multipart = "multipart/byteranges; boundary=";
+		multipart.append(boundary);
+		setHeader(HEADER_STATUS, "206 Partial Content");
+		setHeader(HEADER_CONTENT_TYPE, multipart.c_str());
+		sprintf(buffer, "%llu", length);
+		setHeader(HEADER_CONTENT_LENGTH, buffer);
+		if (headRequest())
+			return;
+
+		ResponseBuffer& out = output();
+		for (size_t i = 0; i < parts.size(); ++i)
+		{
+			out.append(parts[i].data(), parts[i].length());
+			if (!source.send(out, ranges[i].first, ranges[i].length()))
+				die();
+		}
+		out.append(closing.data(), closing.length());
+	}
+
+	void Request::errorPage(int status, const char* statusLine, const char* reason)
 	{
 		if (!reason)
-			setHeader("Status", "400 Bad Request");
+			setHeader(HEADER_STATUS, statusLine);
 		else
 		{
-			std::string msg = "400 ";
+			std::string msg = std::to_string(status);
+			msg += " ";
 			msg += reason;
-			setHeader("Status", msg.c_str());
+			setHeader(HEADER_STATUS, msg.c_str());
 		}
-		setHeader("Content-Type", "text/html; charset=utf-8");
+		setHeader(HEADER_CONTENT_TYPE, "text/html; charset=utf-8");
 
-		auto handler = app().getErrorHandler(400);
+		auto handler = app().getErrorHandler(status);
 		if (handler)
-			handler->onError(400, *this);
+			handler->onError(status, *this);
 		else
 		{
 			*this
-				<< "<tt>400: Oops! (URL: " << getParam("REQUEST_URI") << ")</tt>";
+				<< "<tt>" << status << ": Oops! (URL: " << getParam("REQUEST_URI") << ")</tt>";
 			if (reason && *reason)
 				*this << "<br/>" << reason;
 #if DEBUG_CGI
@@ -502,28 +1248,19 @@ namespace FastCGI
 		die();
 	}
 
+	void Request::on400(const char* reason)
+	{
+		errorPage(400, "400 Bad Request", reason);
+	}
+
 	void Request::on404()
 	{
-		setHeader("Status", "404 Not Found");
-		setHeader("Content-Type", "text/html; charset=utf-8");
+		errorPage(404, "404 Not Found", nullptr);
+	}
 
-		auto handler = app().getErrorHandler(404);
-		if (handler)
-			handler->onError(404, *this);
-		else
-		{
-			*this
-				<< "<tt>404: Oops! (URL: " << getParam("REQUEST_URI") << ")</tt>";
-#if DEBUG_CGI
-			*this << "<br/>\n<a href='/debug/'>Debug</a>";
-			if (!m_icicle.empty())
-			{
-				*this << ", <a href='/debug/?frozen=" + url::encode(m_icicle) + "'>[F]</a>";
-			}
-			*this << ".";
-#endif
-		}
-		die();
+	void Request::on413()
+	{
+		errorPage(413, "413 Request Entity Too Large", nullptr);
 	}
 
 	void Request::__on500(const char* file, int line, const std::string& log)
@@ -537,26 +1274,7 @@ namespace FastCGI
 			FastCGI::ApplicationLog(file, line) << "[500] icicle: " << m_icicle;
 #endif
 
-		setHeader("Status", "500 Internal Error");
-		setHeader("Content-Type", "text/html; charset=utf-8");
-
-		auto handler = app().getErrorHandler(500);
-		if (handler)
-			handler->onError(500, *this);
-		else
-		{
-			*this
-				<< "<tt>500: Oops! (URL: " << getParam("REQUEST_URI") << ")</tt>";
-#if DEBUG_CGI
-			*this << "<br/>\n<a href='/debug/'>Debug</a>";
-			if (!m_icicle.empty())
-			{
-				*this << ", <a href='/debug/?frozen=" + url::encode(m_icicle) + "'>[F]</a>";
-			}
-			*this << ".";
-#endif
-		}
-		die();
+		errorPage(500, "500 Internal Error", nullptr);
 	}
 
 	const std::string& Request::getStaticResources()
@@ -578,7 +1296,7 @@ namespace FastCGI
 	SessionPtr Request::getSession(bool require)
 	{
 		SessionPtr out;
-		param_t sessionId = getCookie("reader.login");
+		param_t sessionId = getCookie(SESSION_COOKIE);
 		if (sessionId && *sessionId)
 			out = app().getSession(*this, sessionId);
 		if (require && out.get() == nullptr)
@@ -606,9 +1324,9 @@ namespace FastCGI
 		if (session.get())
 		{
 			if (long_session)
-				setCookie("reader.login", session->getSessionId(), tyme::now() + 30 * 24 * 60 * 60);
+				setCookie(SESSION_COOKIE, session->getSessionId(), tyme::now() + 30 * 24 * 60 * 60);
 			else
-				setCookie("reader.login", session->getSessionId());
+				setCookie(SESSION_COOKIE, session->getSessionId());
 
 #if DEBUG_CGI
 			if (!m_icicle.empty())
@@ -625,7 +1343,7 @@ namespace FastCGI
 	void Request::endSession(const std::string& sessionId)
 	{
 		app().endSession(*this, sessionId);
-		setCookie("reader.login", "", tyme::now());
+		setCookie(SESSION_COOKIE, "", tyme::now());
 	}
 
 	lng::TranslationPtr Request::getTranslation(const std::string& lang)
@@ -686,8 +1404,8 @@ namespace FastCGI
 #else
 		auto filter = std::make_shared<RequestFilter>(*this);
 		message->pipe(filter);
-		setHeader("Content-Type", "application/octet-stream; charset=utf-8");
-		setHeader("Content-Disposition", "inline; filename=reset.eml");
+		setHeader(HEADER_CONTENT_TYPE, "application/octet-stream; charset=utf-8");
+		setHeader(HEADER_CONTENT_DISPOSITION, "inline; filename=reset.eml");
 
 		//RequestStream dbg{ *this };
 		//doc->debug(dbg);
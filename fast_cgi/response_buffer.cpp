@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/response_buffer.hpp>
+#include <limits.h>
+#include <stdio.h>
+
+namespace FastCGI
+{
+	ResponseBuffer::ResponseBuffer()
+		: m_data(nullptr)
+		, m_capacity(0)
+		, m_flushThreshold(DEFAULT_FLUSH_THRESHOLD)
+		, m_flushed(0)
+		, m_sink(nullptr)
+		, m_stream(this)
+	{
+	}
+
+	ResponseBuffer::~ResponseBuffer()
+	{
+		delete [] m_data;
+	}
+
+	void ResponseBuffer::setUsed(size_t used)
+	{
+		setp(m_data, m_data + m_capacity);
+		while (used > INT_MAX)
+		{
+			pbump(INT_MAX);
+			used -= INT_MAX;
+		}
+		pbump((int)used);
+	}
+
+	char* ResponseBuffer::room(size_t size)
+	{
+		size_t used = this->size();
+		if (used + size <= m_capacity)
+		{
+			char* ptr = pptr();
+			setUsed(used + size);
+			return ptr;
+		}
+
+		// rather than growing past the threshold, let the data go
+		if (m_sink && used && used + size > m_flushThreshold)
+		{
+			flush();
+			used = 0;
+		}
+
+		if (used + size > m_capacity)
+		{
+			size_t capacity = m_capacity ? m_capacity : (size_t)DEFAULT_CAPACITY;
+			while (capacity < used + size)
+				capacity *= 2;
+
+			char* data = new char[capacity];
+			if (used)
+				memcpy(data, m_data, used);
+			delete [] m_data;
+			m_data = data;
+			m_capacity = capacity;
+		}
+
+		setUsed(used + size);
+		return m_data + used;
+	}
+
+	ResponseBuffer::int_type ResponseBuffer::overflow(int_type ch)
+	{
+		if (traits_type::eq_int_type(ch, traits_type::eof()))
+			return traits_type::not_eof(ch);
+
+		*room(1) = traits_type::to_char_type(ch);
+		return ch;
+	}
+
+	std::streamsize ResponseBuffer::xsputn(const char* data, std::streamsize size)
+	{
+		append(data, (size_t)size);
+		return size;
+	}
+
+	void ResponseBuffer::attach(ResponseSink* sink)
+	{
+		m_sink = sink;
+		m_flushed = 0;
+		clear();
+		m_stream.clear();
+		m_stream.flags(std::ios_base::dec | std::ios_base::skipws);
+		m_stream.precision(6);
+		m_stream.width(0);
+		m_stream.fill(' ');
+	}
+
+	void ResponseBuffer::detach()
+	{
+		if (m_sink)
+			m_sink->finish(data(), size());
+		clear();
+		m_sink = nullptr;
+	}
+
+	void ResponseBuffer::flush()
+	{
+		if (m_sink && !empty())
+			m_sink->write(data(), size());
+		m_flushed += size();
+		clear();
+	}
+
+	void ResponseBuffer::append(const char* data, size_t size)
+	{
+		if (!size)
+			return;
+
+		// large blocks (e.g. cached files) go to the sink without a copy
+		if (m_sink && size >= m_flushThreshold)
+		{
+			flush();
+			while (size)
+			{
+				size_t chunk = size < (size_t)DIRECT_CHUNK_SIZE ? size : (size_t)DIRECT_CHUNK_SIZE;
+				m_sink->write(data, chunk);
+				m_flushed += chunk;
+				data += chunk;
+				size -= chunk;
+			}
+			return;
+		}
+
+		memcpy(room(size), data, size);
+	}
+
+	void ResponseBuffer::append(long long value)
+	{
+		if (value < 0)
+		{
+			append('-');
+			// works for LLONG_MIN as well
+			append(0ull - (unsigned long long)value);
+			return;
+		}
+		append((unsigned long long)value);
+	}
+
+	void ResponseBuffer::append(unsigned long long value)
+	{
+		char digits[24];
+		char* end = digits + sizeof(digits);
+		char* ptr = end;
+		do
+		{
+			*--ptr = (char)('0' + value % 10);
+			value /= 10;
+		} while (value);
+		append(ptr, (size_t)(end - ptr));
+	}
+
+	void ResponseBuffer::append(double value)
+	{
+		// the same, as the default formatting of the std::ostream
+		char buffer[64];
+		int length = snprintf(buffer, sizeof(buffer), "%g", value);
+		if (length <= 0 || (size_t)length >= sizeof(buffer))
+			return;
+
+		// snprintf() follows the LC_NUMERIC, the stream does not; the
+		// decimal point of the locale, one or more bytes, becomes the dot
+		size_t out = 0;
+		bool point = false;
+		for (int i = 0; i < length; ++i)
+		{
+			char c = buffer[i];
+			if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+')
+				buffer[out++] = c; // "inf" and "nan" as well
+			else if (!point)
+			{
+				buffer[out++] = '.';
+				point = true;
+			}
+		}
+		append(buffer, out);
+	}
+}
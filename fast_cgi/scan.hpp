@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef __SCAN_HPP__
+#define __SCAN_HPP__
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_AVX2 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCAN_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Scanning kernels for the url-encoded data, the cookies and the JSON
+// strings. Each of
+// them looks at 32 (AVX2) or 16 (SSE2) bytes at a time and falls back
+// to plain loops for the tail of the input and on platforms without
+// the instructions.
+
+namespace FastCGI { namespace impl { namespace scan {
+
+	inline unsigned lowest_bit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	inline bool is_escape(char c) { return c == '%' || c == '+'; }
+
+	inline int hex_digit(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	// One name=value pair of a query string or a form
+	struct Pair
+	{
+		const char* end; // the '&' closing the pair, or the end of input
+		const char* eq;  // first '=' inside the pair, or nullptr
+		bool nameEscaped;
+		bool valueEscaped;
+	};
+
+	// Applies the bit masks of a single block; returns true, if the
+	// block contained the end of the pair.
+	inline bool pair_block(const char* block, uint32_t amp, uint32_t eq, uint32_t esc, Pair& out)
+	{
+		if (amp)
+		{
+			uint32_t before_amp = (1u << lowest_bit(amp)) - 1;
+			eq &= before_amp;
+			esc &= before_amp;
+		}
+
+		if (!out.eq && eq)
+		{
+			unsigned at = lowest_bit(eq);
+			uint32_t before_eq = (1u << at) - 1;
+			out.eq = block + at;
+			if (esc & before_eq)
+				out.nameEscaped = true;
+			if (esc & ~before_eq)
+				out.valueEscaped = true;
+		}
+		else if (esc)
+		{
+			if (out.eq)
+				out.valueEscaped = true;
+			else
+				out.nameEscaped = true;
+		}
+
+		if (amp)
+		{
+			out.end = block + lowest_bit(amp);
+			return true;
+		}
+		return false;
+	}
+
+	inline Pair pair(const char* c, const char* end)
+	{
+		Pair out = { end, nullptr, false, false };
+
+#if SCAN_AVX2
+		const __m256i amp32 = _mm256_set1_epi8('&');
+		const __m256i eq32 = _mm256_set1_epi8('=');
+		const __m256i pct32 = _mm256_set1_epi8('%');
+		const __m256i plus32 = _mm256_set1_epi8('+');
+		while (end - c >= 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)c);
+			uint32_t amp = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, amp32));
+			uint32_t eq = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, eq32));
+			uint32_t esc = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+				_mm256_cmpeq_epi8(block, pct32), _mm256_cmpeq_epi8(block, plus32)));
+			if (pair_block(c, amp, eq, esc, out))
+				return out;
+			c += 32;
+		}
+#endif
+
+#if SCAN_SSE2
+		const __m128i amp16 = _mm_set1_epi8('&');
+		const __m128i eq16 = _mm_set1_epi8('=');
+		const __m128i pct16 = _mm_set1_epi8('%');
+		const __m128i plus16 = _mm_set1_epi8('+');
+		while (end - c >= 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)c);
+			uint32_t amp = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, amp16));
+			uint32_t eq = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, eq16));
+			uint32_t esc = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(block, pct16), _mm_cmpeq_epi8(block, plus16)));
+			if (pair_block(c, amp, eq, esc, out))
+				return out;
+			c += 16;
+		}
+#endif
+
+		for (; c < end; ++c)
+		{
+			if (*c == '&')
+			{
+				out.end = c;
+				break;
+			}
+
+			if (*c == '=')
+			{
+				if (!out.eq)
+					out.eq = c;
+			}
+			else if (is_escape(*c))
+			{
+				if (out.eq)
+					out.valueEscaped = true;
+				else
+					out.nameEscaped = true;
+			}
+		}
+
+		return out;
+	}
+
+	// first occurrence of either of the characters, or end
+	inline const char* find_either(const char* c, const char* end, char first, char second)
+	{
+#if SCAN_AVX2
+		const __m256i first32 = _mm256_set1_epi8(first);
+		const __m256i second32 = _mm256_set1_epi8(second);
+		while (end - c >= 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)c);
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+				_mm256_cmpeq_epi8(block, first32), _mm256_cmpeq_epi8(block, second32)));
+			if (mask)
+				return c + lowest_bit(mask);
+			c += 32;
+		}
+#endif
+
+#if SCAN_SSE2
+		const __m128i first16 = _mm_set1_epi8(first);
+		const __m128i second16 = _mm_set1_epi8(second);
+		while (end - c >= 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)c);
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(block, first16), _mm_cmpeq_epi8(block, second16)));
+			if (mask)
+				return c + lowest_bit(mask);
+			c += 16;
+		}
+#endif
+
+		while (c < end && *c != first && *c != second)
+			++c;
+		return c;
+	}
+
+	inline const char* find_escape(const char* c, const char* end)
+	{
+		return find_either(c, end, '%', '+');
+	}
+
+	// end of a single cookie in the Cookie header
+	inline const char* find_cookie_end(const char* c, const char* end)
+	{
+		return find_either(c, end, ';', ',');
+	}
+
+	// first character, which needs escaping in a JSON string: the quote,
+	// the backslash or a control character
+	inline const char* find_json_escape(const char* c, const char* end)
+	{
+#if SCAN_AVX2
+		const __m256i quote32 = _mm256_set1_epi8('"');
+		const __m256i backslash32 = _mm256_set1_epi8('\\');
+		const __m256i control32 = _mm256_set1_epi8(0x1F);
+		while (end - c >= 32)
+		{
+			__m256i block = _mm256_loadu_si256((const __m256i*)c);
+			__m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(block, control32), control32); // unsigned block <= 0x1F
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(control, _mm256_or_si256(
+				_mm256_cmpeq_epi8(block, quote32), _mm256_cmpeq_epi8(block, backslash32))));
+			if (mask)
+				return c + lowest_bit(mask);
+			c += 32;
+		}
+#endif
+
+#if SCAN_SSE2
+		const __m128i quote16 = _mm_set1_epi8('"');
+		const __m128i backslash16 = _mm_set1_epi8('\\');
+		const __m128i control16 = _mm_set1_epi8(0x1F);
+		while (end - c >= 16)
+		{
+			__m128i block = _mm_loadu_si128((const __m128i*)c);
+			__m128i control = _mm_cmpeq_epi8(_mm_max_epu8(block, control16), control16);
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(control, _mm_or_si128(
+				_mm_cmpeq_epi8(block, quote16), _mm_cmpeq_epi8(block, backslash16))));
+			if (mask)
+				return c + lowest_bit(mask);
+			c += 16;
+		}
+#endif
+
+		while (c < end && *c != '"' && *c != '\\' && (unsigned char)*c >= 0x20)
+			++c;
+		return c;
+	}
+
+	inline bool escaped(const char* data, size_t len)
+	{
+		return find_escape(data, data + len) != data + len;
+	}
+
+	// dst must have room for at least len bytes; returns the decoded
+	// length. Runs without escapes are copied in one go.
+	inline size_t decode(const char* src, size_t len, char* dst)
+	{
+		const char* end = src + len;
+		char* out = dst;
+		while (src < end)
+		{
+			const char* esc = find_escape(src, end);
+			memcpy(out, src, esc - src);
+			out += esc - src;
+			src = esc;
+			if (src == end)
+				break;
+
+			char c = *src++;
+			if (c == '+')
+				c = ' ';
+			else if (end - src >= 2)
+			{
+				int hi = hex_digit(src[0]);
+				int lo = hex_digit(src[1]);
+				if (hi >= 0 && lo >= 0)
+				{
+					c = (char)(hi << 4 | lo);
+					src += 2;
+				}
+			}
+			*out++ = c;
+		}
+		return out - dst;
+	}
+}}}
+
+#endif //__SCAN_HPP__
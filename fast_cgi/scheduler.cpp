@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <fast_cgi/scheduler.hpp>
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		Scheduler::Scheduler()
+			: m_workers(new Worker[MAX_WORKERS])
+			, m_used(0)
+			, m_next(0)
+			, m_pending(0)
+			, m_stopping(false)
+			, m_waitTotal(0)
+			, m_waitCount(0)
+		{
+		}
+
+		size_t Scheduler::attach()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			size_t used = m_used;
+			for (size_t slot = 0; slot < used; ++slot)
+			{
+				if (!m_workers[slot].m_active)
+				{
+					m_workers[slot].m_leaving = false;
+					m_workers[slot].m_active = true;
+					return slot;
+				}
+			}
+
+			if (used == MAX_WORKERS)
+				return NO_SLOT;
+
+			m_workers[used].m_leaving = false;
+			m_workers[used].m_active = true;
+			m_used = used + 1;
+			return used;
+		}
+
+		void Scheduler::detach(size_t slot)
+		{
+			if (slot >= MAX_WORKERS)
+				return;
+
+			// nothing new is put there, and what is still queued is
+			// taken by the other threads, as if it were stolen
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_workers[slot].m_active = false;
+			if (m_pending)
+				m_ready.notify_all();
+		}
+
+		void Scheduler::leave(size_t slot)
+		{
+			if (slot >= MAX_WORKERS)
+				return;
+
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_workers[slot].m_leaving = true;
+			m_ready.notify_all();
+		}
+
+		void Scheduler::push(const QueuedRequestPtr& request)
+		{
+			size_t used = m_used;
+			size_t start = used ? m_next++ % used : 0;
+			size_t best = 0;
+			size_t bestDepth = (size_t)-1;
+			for (size_t i = 0; i < used; ++i)
+			{
+				size_t slot = (start + i) % used;
+				Worker& worker = m_workers[slot];
+				if (!worker.m_active || worker.m_leaving)
+					continue;
+
+				size_t depth = worker.m_depth;
+				if (depth < bestDepth)
+				{
+					best = slot;
+					bestDepth = depth;
+					if (!depth)
+						break;
+				}
+			}
+
+			Worker& worker = m_workers[best];
+			{
+				std::lock_guard<std::mutex> guard(worker.m_lock);
+				Entry entry = { request, clock::now() };
+				worker.m_queue.push_back(entry);
+				++worker.m_depth;
+			}
+
+			std::lock_guard<std::mutex> guard(m_lock);
+			++m_pending;
+			m_ready.notify_one();
+		}
+
+		QueuedRequestPtr Scheduler::pop(size_t slot)
+		{
+			if (slot >= MAX_WORKERS)
+				return nullptr;
+
+			Worker& worker = m_workers[slot];
+			if (!worker.m_depth)
+				return nullptr;
+
+			Entry entry;
+			{
+				std::lock_guard<std::mutex> guard(worker.m_lock);
+				if (worker.m_queue.empty())
+					return nullptr;
+
+				entry = worker.m_queue.front();
+				worker.m_queue.pop_front();
+				--worker.m_depth;
+			}
+
+			taken(entry.queued);
+			return entry.request;
+		}
+
+		QueuedRequestPtr Scheduler::steal(size_t thief)
+		{
+			size_t used = m_used;
+			for (size_t attempt = 0; attempt < used; ++attempt)
+			{
+				size_t victim = NO_SLOT;
+				size_t longest = 0;
+				for (size_t slot = 0; slot < used; ++slot)
+				{
+					size_t depth = m_workers[slot].m_depth;
+					if (slot != thief && depth > longest)
+					{
+						victim = slot;
+						longest = depth;
+					}
+				}
+
+				if (victim == NO_SLOT)
+					return nullptr;
+
+				// the oldest one; it is the one that waited the longest
+				QueuedRequestPtr request = pop(victim);
+				if (request)
+					return request;
+			}
+			return nullptr;
+		}
+
+		void Scheduler::taken(clock::time_point queued)
+		{
+			auto wait = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - queued);
+			m_waitTotal += (unsigned long long)wait.count();
+			++m_waitCount;
+
+			std::lock_guard<std::mutex> guard(m_lock);
+			--m_pending;
+		}
+
+		QueuedRequestPtr Scheduler::next(size_t slot)
+		{
+			auto leaving = [this, slot] { return slot < MAX_WORKERS && m_workers[slot].m_leaving; };
+
+			std::unique_lock<std::mutex> lock(m_lock, std::defer_lock);
+			while (true)
+			{
+				lock.lock();
+				if (m_stopping || leaving())
+					return nullptr;
+				lock.unlock();
+
+				QueuedRequestPtr request = pop(slot);
+				if (!request)
+					request = steal(slot);
+				if (request)
+					return request;
+
+				lock.lock();
+				m_ready.wait(lock, [&] { return m_stopping || m_pending || leaving(); });
+				lock.unlock();
+			}
+		}
+
+		void Scheduler::shutdown()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_stopping = true;
+			m_ready.notify_all();
+		}
+
+		size_t Scheduler::depth(size_t slot) const
+		{
+			return slot < MAX_WORKERS ? m_workers[slot].m_depth.load() : 0;
+		}
+
+		size_t Scheduler::pending()
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			return m_pending;
+		}
+
+		unsigned long long Scheduler::sampleWait()
+		{
+			unsigned long long total = m_waitTotal.exchange(0);
+			unsigned long long count = m_waitCount.exchange(0);
+			return count ? total / count : 0;
+		}
+	}
+}
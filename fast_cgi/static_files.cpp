@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include <static_files.hpp>
+#include <fast_cgi/compression.hpp>
+#include <unordered_map>
+#include <list>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+
+namespace FastCGI { namespace app {
+
+	namespace
+	{
+		struct ContentType
+		{
+			const char* ext;
+			const char* type;
+		};
+
+		const ContentType s_types[] = {
+			{ "html", "text/html; charset=utf-8" },
+			{ "htm",  "text/html; charset=utf-8" },
+			{ "css",  "text/css; charset=utf-8" },
+			{ "js",   "application/javascript; charset=utf-8" },
+			{ "json", "application/json; charset=utf-8" },
+			{ "xml",  "application/xml; charset=utf-8" },
+			{ "txt",  "text/plain; charset=utf-8" },
+			{ "svg",  "image/svg+xml" },
+			{ "png",  "image/png" },
+			{ "gif",  "image/gif" },
+			{ "jpg",  "image/jpeg" },
+			{ "jpeg", "image/jpeg" },
+			{ "ico",  "image/x-icon" },
+			{ "webp", "image/webp" },
+			{ "woff", "font/woff" },
+			{ "woff2","font/woff2" },
+			{ "ttf",  "font/ttf" },
+			{ "pdf",  "application/pdf" },
+			{ "zip",  "application/zip" },
+			{ "gz",   "application/gzip" },
+		};
+
+		struct CachedFile
+		{
+			time_t mtime;
+			unsigned long long size;
+			std::string contents;
+		};
+		typedef std::shared_ptr<CachedFile> CachedFilePtr;
+
+		// Process-wide, least recently used files are dropped first.
+		class FileCache: public mt::AsyncData
+		{
+			typedef std::list<std::pair<std::string, CachedFilePtr>> Entries;
+
+			Entries m_entries;
+			std::unordered_map<std::string, Entries::iterator> m_index;
+			size_t m_size;
+		public:
+			FileCache() : m_size(0) {}
+
+			static FileCache& get()
+			{
+				static FileCache instance;
+				return instance;
+			}
+
+			CachedFilePtr find(const std::string& path, time_t mtime, unsigned long long size)
+			{
+				Synchronize on (*this);
+				auto _it = m_index.find(path);
+				if (_it == m_index.end())
+					return nullptr;
+
+				CachedFilePtr file = _it->second->second;
+				if (file->mtime != mtime || file->size != size)
+				{
+					m_size -= file->contents.size();
+					m_entries.erase(_it->second);
+					m_index.erase(_it);
+					return nullptr;
+				}
+
+				m_entries.splice(m_entries.begin(), m_entries, _it->second);
+				return file;
+			}
+
+			void store(const std::string& path, const CachedFilePtr& file)
+			{
+				Synchronize on (*this);
+				auto _it = m_index.find(path);
+				if (_it != m_index.end())
+				{
+					m_size -= _it->second->second->contents.size();
+					m_entries.erase(_it->second);
+					m_index.erase(_it);
+				}
+
+				m_entries.emplace_front(path, file);
+				m_index[path] = m_entries.begin();
+				m_size += file->contents.size();
+
+				while (m_size > StaticFileHandler::MAX_CACHE_SIZE && m_entries.size() > 1)
+				{
+					auto& last = m_entries.back();
+					m_size -= last.second->contents.size();
+					m_index.erase(last.first);
+					m_entries.pop_back();
+				}
+			}
+		};
+	}
+
+	static inline int hex_digit(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	// Only the %XX escapes are decoded; the "+" is a space in the query, not in the path.
+	// Anything trying to get out of the data directory is rejected.
+	static bool localPath(param_t uri, std::string& path, bool dotFiles)
+	{
+		if (!uri || *uri != '/')
+			return false;
+
+		path.clear();
+		for (const char* c = uri; *c && *c != '?'; ++c)
+		{
+			char ch = *c;
+			if (ch == '%')
+			{
+				int hi = hex_digit(c[1]);
+				int lo = hi < 0 ? -1 : hex_digit(c[2]);
+				if (lo < 0)
+					return false;
+				ch = (char)(hi * 16 + lo);
+				c += 2;
+			}
+
+			if (!ch || ch == '\\')
+				return false;
+			path.push_back(ch);
+		}
+
+		size_t pos = 0;
+		while ((pos = path.find("/.", pos)) != std::string::npos)
+		{
+			pos += 2;
+			if (!dotFiles)
+				return false;
+			if (pos < path.length() && path[pos] == '.' && (pos + 1 == path.length() || path[pos + 1] == '/'))
+				return false;
+		}
+
+		return path[path.length() - 1] != '/';
+	}
+
+	static CachedFilePtr loadFile(const std::string& path, time_t mtime, unsigned long long size)
+	{
+		CachedFilePtr file = FileCache::get().find(path, mtime, size);
+		if (file)
+			return file;
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4996)
+#endif
+		FILE* f = fopen(path.c_str(), "rb");
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+		if (!f)
+			return nullptr;
+
+		file = std::make_shared<CachedFile>();
+		file->mtime = mtime;
+		file->size = size;
+		file->contents.resize((size_t)size);
+		size_t read = size ? fread(&file->contents[0], 1, (size_t)size, f) : 0;
+		fclose(f);
+		if (read != size)
+			return nullptr;
+
+		FileCache::get().store(path, file);
+		return file;
+	}
+
+	const char* StaticFileHandler::contentType(const std::string& path)
+	{
+		size_t dot = path.rfind('.');
+		size_t slash = path.rfind('/');
+		if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		{
+			std::string ext = path.substr(dot + 1);
+			for (auto&& c : ext)
+				c = (char)tolower((unsigned char)c);
+
+			for (auto&& type : s_types)
+			{
+				if (ext == type.ext)
+					return type.type;
+			}
+		}
+		return "application/octet-stream";
+	}
+
+	void StaticFileHandler::visit(Request& request)
+	{
+		std::string local;
+		if (!localPath(request.getParam("REQUEST_URI"), local, servesDotFiles()))
+			request.on404();
+
+		std::string path = request.app().getDataDir().native() + local;
+		filesystem::status st{ path };
+		if (!st.exists() || filesystem::is_directory(path))
+			request.on404();
+
+		time_t mtime = st.mtime();
+		time_t fileTime = mtime;
+		unsigned long long size = st.file_size();
+		bool gzipped = false;
+
+		std::string gz = path + ".gz";
+		filesystem::status gzst{ gz };
+		if (gzst.exists())
+		{
+			request.setHeader(HEADER_VARY, "Accept-Encoding");
+			if (gzst.mtime() >= mtime && impl::Compressor::negotiate(request.getParam("HTTP_ACCEPT_ENCODING")) == impl::Compressor::GZIP)
+			{
+				path = gz;
+				fileTime = gzst.mtime();
+				size = gzst.file_size();
+				gzipped = true;
+				request.setHeader(HEADER_CONTENT_ENCODING, "gzip");
+			}
+		}
+
+		request.setHeader(HEADER_CONTENT_TYPE, contentType(local));
+
+		char key[64];
+		sprintf(key, "%llx-%llx%s", size, (unsigned long long)mtime, gzipped ? "-gz" : "");
+		request.onETag(key);
+		request.onLastModified(mtime);
+
+		if (size <= MAX_CACHED_FILE)
+		{
+			CachedFilePtr file = loadFile(path, fileTime, size);
+			if (file)
+			{
+				MemorySource source(file->contents);
+				request.sendRanges(source);
+				return;
+			}
+		}
+
+		FileSource source;
+		if (!source.open(path))
+			request.on404();
+		request.sendRanges(source);
+	}
+
+}} // FastCGI::app
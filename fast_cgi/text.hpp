@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __TEXT_HPP__
+#define __TEXT_HPP__
+
+#include <string.h>
+
+// The small string helpers the parsers of the headers, cookies and
+// forms share. ASCII only, independent of the current C locale.
+
+namespace FastCGI { namespace impl { namespace text {
+
+	inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f'; }
+	inline char to_lower(char c) { return c >= 'A' && c <= 'Z' ? (char)(c + 'a' - 'A') : c; }
+
+	inline void trim(const char*& begin, const char*& end)
+	{
+		while (begin < end && is_space(*begin)) ++begin;
+		while (begin < end && is_space(end[-1])) --end;
+	}
+
+	inline bool iequals(const char* lhs, const char* rhs, size_t length)
+	{
+		for (size_t i = 0; i < length; ++i)
+		{
+			if (to_lower(lhs[i]) != to_lower(rhs[i]))
+				return false;
+		}
+		return true;
+	}
+
+	inline bool iequals(const char* data, size_t size, const char* lit)
+	{
+		return strlen(lit) == size && iequals(data, lit, size);
+	}
+}}}
+
+#endif //__TEXT_HPP__
@@ -27,16 +27,45 @@
 #include <fast_cgi/application.hpp>
 #include <fast_cgi/request.hpp>
 #include <fast_cgi/backends.hpp>
+#include <fast_cgi/engine.hpp>
+#include <chrono>
 
 namespace FastCGI
 {
+	static inline long long nanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
 	Thread::Thread()
 		: m_backend(std::make_shared<impl::LibFCGIThread>())
+		, m_cookieExpires(HttpDate::COOKIE)
+		, m_serializeAccept(true)
+		, m_busyTime(0)
+		, m_requestStart(0)
+		, m_load(0)
+		, m_lastBusy(0)
+		, m_lastSample(0)
+		, m_initialized(false)
+		, m_ownsSocket(false)
+		, m_retiring(false)
+		, m_finished(false)
 	{
 	}
 
 	Thread::Thread(const char* uri)
 		: m_backend(std::make_shared<impl::STLThread>(uri))
+		, m_cookieExpires(HttpDate::COOKIE)
+		, m_serializeAccept(true)
+		, m_busyTime(0)
+		, m_requestStart(0)
+		, m_load(0)
+		, m_lastBusy(0)
+		, m_lastSample(0)
+		, m_initialized(false)
+		, m_ownsSocket(false)
+		, m_retiring(false)
+		, m_finished(false)
 	{
 	}
 
@@ -49,10 +78,34 @@ namespace FastCGI
 		if (!m_backend || !m_app)
 			return false;
 
+		m_serializeAccept = true;
+		if (dynamic_cast<impl::EngineThread*>(m_backend.get()))
+			m_serializeAccept = false; // the engine accepts the connections
+		else if (m_app->getAcceptMode() == Application::ACCEPT_CONCURRENT)
+			m_serializeAccept = false;
+		else if (m_app->getAcceptMode() == Application::ACCEPT_REUSEPORT)
+		{
+			m_ownsSocket = m_backend->listen(m_app->getListenAddress());
+			m_serializeAccept = !m_ownsSocket;
+		}
+
+		m_backend->setOutputBufferSize(m_app->getOutputBufferSize());
 		m_backend->init();
+
+		// from now on, the backend may be woken up by retire()
+		m_initialized = true;
 		return true;
 	}
 
+	void Thread::prepare()
+	{
+		// the engine accepts the connections, the thread only takes
+		// the requests off its queue
+		impl::EventEnginePtr engine = m_app ? m_app->engine() : nullptr;
+		if (engine && dynamic_cast<impl::LibFCGIThread*>(m_backend.get()))
+			m_backend = std::make_shared<impl::EngineThread>(engine);
+	}
+
 	void Thread::reload()
 	{
 		m_dbConn.reset(); // reopen it next time...
@@ -61,6 +114,9 @@ namespace FastCGI
 	bool Thread::accept()
 	{
 		try {
+			if (!m_serializeAccept)
+				return m_backend->accept();
+
 			// Some platforms require accept() serialization, some don't..
 			static mt::AsyncData accept_guard;
 
@@ -76,15 +132,27 @@ namespace FastCGI
 	void Thread::run()
 	{
 		if (!init())
+		{
+			m_finished = true;
 			return;
-		while (accept())
+		}
+
+		while (!m_retiring && accept())
 		{
+			long long start = nanoseconds();
+			m_requestStart = start;
+
 			handleRequest();
 			m_backend->release();
+			m_arena.reset();
+
+			m_busyTime += nanoseconds() - start;
+			m_requestStart = 0;
 
-			if (shouldStop())
+			if (shouldStop() || m_retiring)
 				break;
 		}
+		m_finished = true;
 	}
 
 	void Thread::shutdown()
@@ -92,6 +160,32 @@ namespace FastCGI
 		m_backend->shutdown();
 	}
 
+	void Thread::sampleLoad()
+	{
+		long long now = nanoseconds();
+		long long busy = m_busyTime;
+		long long start = m_requestStart;
+		if (start)
+			busy += now - start; // the request still running counts, too
+
+		if (m_lastSample && now > m_lastSample)
+		{
+			long long load = (busy - m_lastBusy) * 100 / (now - m_lastSample);
+			m_load = (unsigned long)(load < 0 ? 0 : load > 100 ? 100 : load);
+		}
+
+		m_lastBusy = busy;
+		m_lastSample = now;
+	}
+
+	void Thread::retire()
+	{
+		// before init(), run() sees the flag on its own
+		m_retiring = true;
+		if (m_initialized)
+			m_backend->retire();
+	}
+
 	void Thread::handleRequest()
 	{
 		FastCGI::Request req(*this);
@@ -109,6 +203,9 @@ namespace FastCGI
 		try { onRequest(req); }
 		catch(FastCGI::FinishResponse) {} // die() lands here
 
+		try { req.answerRejectedForm(); }
+		catch(FastCGI::FinishResponse) {}
+
 #if DEBUG_CGI
 		auto now = clock::now();
 		auto ptr = m_app->frozen(icicle);
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pch.h"
+#include <fast_cgi/urlencoded.hpp>
+#include "scan.hpp"
+#include "text.hpp"
+#include <string.h>
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		bool UrlencodedParser::pair(const char* begin, const char* end)
+		{
+			scan::Pair info = scan::pair(begin, end);
+			return pair(begin, info.eq, end, info.nameEscaped, info.valueEscaped);
+		}
+
+		bool UrlencodedParser::pair(const char* begin, const char* eq, const char* end, bool nameEscaped, bool valueEscaped)
+		{
+			text::trim(begin, end);
+			if (begin == end)
+				return true; // "&&"
+
+			if (m_maxFields && m_fields >= m_maxFields)
+				return false;
+			++m_fields;
+
+			if (!eq)
+			{
+				m_handler.onVariable(begin, end - begin, nameEscaped, nullptr, 0, false);
+				return true;
+			}
+
+			const char* name_end = eq;
+			const char* value = eq + 1;
+			text::trim(begin, name_end);
+			text::trim(value, end);
+			m_handler.onVariable(begin, name_end - begin, nameEscaped, value, end - value, valueEscaped);
+			return true;
+		}
+
+		bool UrlencodedParser::feed(const char* data, size_t size)
+		{
+			const char* c = data;
+			const char* end = data + size;
+
+			if (!m_pending.empty())
+			{
+				scan::Pair info = scan::pair(c, end);
+				if (info.end == end)
+				{
+					m_pending.append(c, end);
+					return true;
+				}
+
+				m_pending.append(c, info.end);
+				if (!pair(m_pending.data(), m_pending.data() + m_pending.length()))
+					return false;
+				m_pending.clear();
+				c = info.end + 1;
+			}
+
+			while (c < end)
+			{
+				scan::Pair info = scan::pair(c, end);
+				if (info.end == end)
+				{
+					m_pending.assign(c, end);
+					break;
+				}
+
+				if (!pair(c, info.eq, info.end, info.nameEscaped, info.valueEscaped))
+					return false;
+				c = info.end + 1;
+			}
+
+			return true;
+		}
+
+		bool UrlencodedParser::parse(const char* data, size_t size)
+		{
+			if (!finish())
+				return false;
+
+			const char* c = data;
+			const char* end = data + size;
+			while (c < end)
+			{
+				scan::Pair info = scan::pair(c, end);
+				if (!pair(c, info.eq, info.end, info.nameEscaped, info.valueEscaped))
+					return false;
+				c = info.end + 1;
+			}
+			return true;
+		}
+
+		bool UrlencodedParser::finish()
+		{
+			if (m_pending.empty())
+				return true;
+
+			bool ret = pair(m_pending.data(), m_pending.data() + m_pending.length());
+			m_pending.clear();
+			return ret;
+		}
+	}
+}
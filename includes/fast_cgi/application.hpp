@@ -29,6 +29,7 @@
 #include <locale.hpp>
 #include <mt.hpp>
 #include <sstream>
+#include <functional>
 #if DEBUG_CGI
 #include <chrono>
 #endif
@@ -47,6 +48,13 @@ namespace FastCGI
 	class Session;
 	struct UserInfoFactory;
 	typedef std::shared_ptr<Thread> ThreadPtr;
+
+	namespace impl
+	{
+		class EventEngine;
+		class PoolController;
+		typedef std::shared_ptr<EventEngine> EventEnginePtr;
+	}
 	typedef std::shared_ptr<Session> SessionPtr;
 	using UserInfoFactoryPtr = std::shared_ptr<UserInfoFactory>;
 
@@ -156,9 +164,12 @@ namespace FastCGI
 
 	class Application: public mt::AsyncData
 	{
+		friend class impl::PoolController;
+
 		typedef std::pair<tyme::time_t, SessionPtr> SessionCacheItem;
 		typedef std::map<std::string, SessionCacheItem> Sessions;
 		typedef std::list<ThreadPtr> Threads;
+		typedef std::function<ThreadPtr ()> ThreadFactory;
 
 		long m_pid;
 		std::string m_staticWeb;
@@ -168,23 +179,61 @@ namespace FastCGI
 		filesystem::path m_accessLog;
 		Sessions m_sessions;
 		Threads m_threads;
+		mutable mt::AsyncData m_threadLock; // the pool controller changes m_threads while running
+		ThreadFactory m_threadFactory;
+		size_t m_minThreads;
+		size_t m_maxThreads;
+		std::shared_ptr<impl::PoolController> m_pool;
 		lng::Locale m_locale;
 		std::map<int, ErrorHandlerPtr> m_errorHandlers;
 		UserInfoFactoryPtr m_userInfoFactory;
+		unsigned long long m_maxFormSize;
+		size_t m_maxFormFields;
+		unsigned long long m_maxUploadSize;
+		size_t m_compressionThreshold;
+		size_t m_outputBufferSize;
+		int m_acceptMode;
+		std::string m_listenAddress;
+		bool m_useEventEngine;
+		impl::EventEnginePtr m_engine;
+		std::vector<std::string> m_cookieNames;
 
 		void cleanSessionCache();
 	public:
+		enum
+		{
+			DEFAULT_MAX_FORM_SIZE = 2 * 1024 * 1024,
+			DEFAULT_MAX_FORM_FIELDS = 1000,
+			DEFAULT_MAX_UPLOAD_SIZE = 64 * 1024 * 1024,
+			DEFAULT_COMPRESSION_THRESHOLD = 1024,
+			DEFAULT_OUTPUT_BUFFER_SIZE = 64 * 1024
+		};
+
+		enum AcceptMode
+		{
+			ACCEPT_SERIALIZED, // one thread at a time waits on the shared socket
+			ACCEPT_CONCURRENT, // all threads wait on the shared socket (Linux and BSDs wake only one of them)
+			ACCEPT_REUSEPORT   // every thread listens on its own SO_REUSEPORT socket, the kernel spreads the connections
+		};
+
 		Application();
 		~Application();
 		template <typename T>
 		bool addThreads(int threadCount)
 		{
-			for (int i = 0; i < threadCount; ++i)
+			m_threadFactory = [this]() -> ThreadPtr
 			{
 				auto ptr = std::make_shared<T>();
+				if (ptr)
+					ptr->setApplication(*this);
+				return ptr;
+			};
+
+			for (int i = 0; i < threadCount; ++i)
+			{
+				auto ptr = m_threadFactory();
 				if (!ptr)
 					return false;
-				ptr->setApplication(*this);
 				m_threads.push_back(ptr);
 			}
 			return true;
@@ -218,6 +267,68 @@ namespace FastCGI
 		void setAccessLog(const filesystem::path& log) { m_accessLog = log; }
 		const filesystem::path& getAccessLog() const { return m_accessLog; }
 
+		// larger forms are answered with 413; for multipart/form-data, the
+		// size counts the values of the fields, the files are counted
+		// against the upload size, and the files count as fields
+		void setMaxFormSize(unsigned long long size) { m_maxFormSize = size; }
+		unsigned long long getMaxFormSize() const { return m_maxFormSize; }
+
+		void setMaxFormFields(size_t count) { m_maxFormFields = count; }
+		size_t getMaxFormFields() const { return m_maxFormFields; }
+
+		void setMaxUploadSize(unsigned long long size) { m_maxUploadSize = size; }
+		unsigned long long getMaxUploadSize() const { return m_maxUploadSize; }
+
+		// smaller responses are not worth the gzip header
+		void setCompressionThreshold(size_t size) { m_compressionThreshold = size; }
+		size_t getCompressionThreshold() const { return m_compressionThreshold; }
+
+		// bytes collected by each thread before a batch of FCGI_STDOUT
+		// records is sent to the server; 0 leaves it to libfcgi;
+		// read by the threads when they start
+		void setOutputBufferSize(size_t size) { m_outputBufferSize = size; }
+		size_t getOutputBufferSize() const { return m_outputBufferSize; }
+
+		// ACCEPT_REUSEPORT needs the address ("host:port" or ":port") the web
+		// server connects to; where the option is not available, the threads
+		// fall back to the serialized accept on the inherited socket
+		void setAcceptMode(AcceptMode mode) { m_acceptMode = mode; }
+		AcceptMode getAcceptMode() const { return (AcceptMode)m_acceptMode; }
+		void setListenAddress(const std::string& address) { m_listenAddress = address; }
+		const std::string& getListenAddress() const { return m_listenAddress; }
+
+		// A single epoll thread owns all the connections from the web server
+		// and the threads only handle complete requests, so a slow client
+		// or an idle keep-alive connection does not hold a thread. Listens on
+		// the listen address, if set. Linux only; elsewhere, the threads
+		// accept the connections themselves.
+		void setEventEngine(bool enable) { m_useEventEngine = enable; }
+		bool getEventEngine() const { return m_useEventEngine; }
+		// while running; the threads keep it until they are gone
+		impl::EventEnginePtr engine() const { return m_engine; }
+
+		// requests waiting for each of the threads, in the order the
+		// threads were added; all zeros, if there is no event engine
+		std::vector<size_t> getQueueDepths() const;
+
+		// With the max above 0, the threads from addThreads() are only the
+		// starting pool. More of the same type are started, up to the max,
+		// while the threads are busy or the requests wait in the queues of
+		// the event engine; after a longer quiet spell, they are let go one
+		// at a time, down to the min. With ACCEPT_REUSEPORT, the threads
+		// listening on a socket of their own are never let go (the
+		// connections queued on a closed socket are reset), so without
+		// the event engine, such a pool only grows.
+		void setThreadPool(size_t minThreads, size_t maxThreads) { m_minThreads = minThreads; m_maxThreads = maxThreads; }
+		size_t getMinThreads() const { return m_minThreads; }
+		size_t getMaxThreads() const { return m_maxThreads; }
+
+		// Once any cookie name is registered, the requests will only keep
+		// the registered cookies and skip everything else the browser sends.
+		// The session cookie is registered together with the first name.
+		void addCookieName(const std::string& name);
+		bool isCookieWanted(const char* name, size_t length) const;
+
 		void setErrorHandler(int error, const ErrorHandlerPtr& ptr) { m_errorHandlers[error] = ptr; }
 		ErrorHandlerPtr getErrorHandler(int error)
 		{
@@ -245,7 +356,7 @@ namespace FastCGI
 		std::string freeze(char** envp, const Request& req);
 		void report(char** envp, const std::string& icicle);
 		void reportHeader(const std::string& header, const std::string& icicle);
-		std::list<ThreadPtr> getThreads() const { return m_threads; }
+		std::list<ThreadPtr> getThreads() const { Synchronize on(m_threadLock); return m_threads; }
 	private:
 		ReqList m_requs;
 		Iceberg m_iceberg;
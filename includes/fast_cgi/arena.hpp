@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __ARENA_HPP__
+#define __ARENA_HPP__
+
+#include <memory>
+#include <string>
+#include <map>
+#include <scoped_allocator>
+
+namespace FastCGI
+{
+	// Monotonic (bump) allocator. Memory is handed out from a chain of
+	// blocks and is never given back one allocation at a time; instead,
+	// the whole arena is reset once the request it served is finished.
+	class Arena
+	{
+		struct Block
+		{
+			Block* next;
+			size_t size;
+			char* data() { return reinterpret_cast<char*>(this + 1); }
+		};
+
+		Block* m_blocks;
+		char* m_next;
+		char* m_end;
+		size_t m_blockSize;
+
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		Block* newBlock(size_t size);
+		void freeBlocks();
+	public:
+		enum
+		{
+			DEFAULT_BLOCK_SIZE = 16 * 1024,
+			MAX_RETAINED_SIZE = 1024 * 1024,
+			DEFAULT_ALIGNMENT = 2 * sizeof(void*)
+		};
+
+		explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+		~Arena();
+
+		void* allocate(size_t size, size_t align = DEFAULT_ALIGNMENT);
+		void reset();
+	};
+
+	template <typename T>
+	struct ArenaAllocator
+	{
+		typedef T value_type;
+
+		Arena* m_arena;
+
+		ArenaAllocator() : m_arena(nullptr) {}
+		explicit ArenaAllocator(Arena* arena) : m_arena(arena) {}
+		template <typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+		template <typename U>
+		struct rebind { typedef ArenaAllocator<U> other; };
+
+		T* allocate(size_t n)
+		{
+			// an allocator created without an arena (e.g. for a temporary
+			// lookup key) behaves like std::allocator
+			if (!m_arena)
+				return static_cast<T*>(::operator new(n * sizeof(T)));
+			return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T* ptr, size_t)
+		{
+			if (!m_arena)
+				::operator delete(ptr);
+		}
+	};
+
+	template <typename T, typename U>
+	inline bool operator == (const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) { return lhs.m_arena == rhs.m_arena; }
+
+	template <typename T, typename U>
+	inline bool operator != (const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) { return lhs.m_arena != rhs.m_arena; }
+
+	using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+	template <typename Key, typename Value>
+	using ArenaMap = std::map<Key, Value, std::less<Key>,
+		std::scoped_allocator_adaptor<ArenaAllocator<std::pair<const Key, Value>>>>;
+}
+
+#endif //__ARENA_HPP__
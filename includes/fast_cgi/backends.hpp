@@ -25,12 +25,35 @@
 #ifndef __BACKENDS_HPP__
 #define __BACKENDS_HPP__
 
+#include <vector>
+
 namespace FastCGI
 {
 	namespace impl
 	{
+		// SO_REUSEPORT socket listening on "host:port"; -1, if the
+		// address is a path or the option is not available
+		int listenOn(const std::string& address);
+
+		// whatever the previous request did to the stream
+		void resetStream(std::ios& stream);
+
+		// Built once per thread; the stream buffers are re-seated on the
+		// streams of each accepted request.
+		//
+		// With the output buffer set, the body does not go through the
+		// FCGX_Stream (which sends a record for every 8K); instead, the
+		// buffer is sent as a batch of full-sized FCGI_STDOUT records with
+		// a single writev.
 		class LibFCGIRequest: public RequestBackend
 		{
+			FCGX_Stream* m_in;
+			FCGX_Stream* m_out;
+			int m_fd;
+			int m_requestId;
+			bool m_failed;
+			std::vector<char> m_buffer;
+			size_t m_used;
 			fcgi_streambuf m_streambufCin;
 			fcgi_streambuf m_streambufCout;
 			fcgi_streambuf m_streambufCerr;
@@ -38,22 +61,55 @@ namespace FastCGI
 			std::ostream m_cerr;
 			std::istream m_cin;
 		public:
-			LibFCGIRequest(FCGX_Request& request);
+			LibFCGIRequest();
+			void attach(FCGX_Request& request);
 			std::ostream& cout() override { return m_cout; }
 			std::ostream& cerr() override { return m_cerr; }
 			std::istream& cin() override { return m_cin; }
+			std::streamsize read(char* buffer, std::streamsize size) override
+			{
+				return FCGX_GetStr(buffer, (int)size, m_in);
+			}
+			void write(const char* data, size_t size) override;
+			void flush() override
+			{
+				sendBuffer();
+				FCGX_FFlush(m_out);
+			}
+			long long skip(long long size) override;
+
+			void setBufferSize(size_t size);
+			void sendBuffer();
+		private:
+			void sendRecords(const char* data, size_t size);
 		};
 
 		class LibFCGIThread: public ThreadBackend
 		{
 			FCGX_Request m_request;
+			LibFCGIRequest m_requestBackend;
+			int m_listenSock; // 0 is the socket inherited from the spawner
 		public:
-			void init() override { FCGX_InitRequest(&m_request, 0, 0); }
+			LibFCGIThread() : m_listenSock(0) {}
+			~LibFCGIThread();
+			void init() override { FCGX_InitRequest(&m_request, m_listenSock, 0); }
+			bool listen(const std::string& address) override;
 			const char * const* envp() const override { return m_request.envp; }
-			bool accept() override { return FCGX_Accept_r(&m_request) == 0; }
-			void release() override { FCGX_Finish_r(&m_request); }
+			bool accept() override
+			{
+				if (FCGX_Accept_r(&m_request))
+					return false;
+				m_requestBackend.attach(m_request);
+				return true;
+			}
+			void release() override
+			{
+				m_requestBackend.sendBuffer();
+				FCGX_Finish_r(&m_request);
+			}
 			void shutdown() override { FCGX_ShutdownPending(); }
-			std::shared_ptr<RequestBackend> newRequestBackend() override { return std::make_shared<LibFCGIRequest>(m_request); }
+			void setOutputBufferSize(size_t size) override { m_requestBackend.setBufferSize(size); }
+			RequestBackend& requestBackend() override { return m_requestBackend; }
 		};
 
 		class STLRequest: public RequestBackend
@@ -62,6 +118,20 @@ namespace FastCGI
 			std::ostream& cout() override { return std::cout; }
 			std::ostream& cerr() override { return std::cerr; }
 			std::istream& cin() override { return std::cin; }
+			std::streamsize read(char* buffer, std::streamsize size) override
+			{
+				std::cin.read(buffer, size);
+				return std::cin.gcount();
+			}
+			void write(const char* data, size_t size) override
+			{
+				std::cout.write(data, size);
+			}
+			void flush() override
+			{
+				std::cout.flush();
+			}
+			long long skip(long long size) override;
 		};
 
 		class STLThread: public ThreadBackend
@@ -69,6 +139,7 @@ namespace FastCGI
 			char* REQUEST_URI;
 			char* QUERY_STRING;
 			const char* environment[8];
+			STLRequest m_requestBackend;
 		public:
 			STLThread(const char* uri);
 			~STLThread();
@@ -77,7 +148,7 @@ namespace FastCGI
 			bool accept() override { return false; }
 			void release() override { }
 			void shutdown() override { }
-			std::shared_ptr<RequestBackend> newRequestBackend() override { return std::make_shared<STLRequest>(); }
+			RequestBackend& requestBackend() override { return m_requestBackend; }
 		};
 	};
 }
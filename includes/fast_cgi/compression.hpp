@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __COMPRESSION_HPP__
+#define __COMPRESSION_HPP__
+
+#include <fast_cgi/response_buffer.hpp>
+
+struct z_stream_s;
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		// zlib stream compressing the response body on its way to the
+		// backend. Owned by the thread and reset for every response, so
+		// the deflate state is allocated once, not once per request.
+		class Compressor
+		{
+		public:
+			enum Encoding
+			{
+				NONE,
+				GZIP,
+				DEFLATE
+			};
+
+			Compressor();
+			~Compressor();
+
+			bool start(Encoding encoding);
+			void write(const char* data, size_t size, bool last, ResponseSink& out);
+
+			static Encoding negotiate(const char* acceptEncoding);
+			static const char* name(Encoding encoding);
+			static bool compressible(const param_view& contentType);
+		private:
+			z_stream_s* m_stream;
+			Encoding m_encoding;
+
+			Compressor(const Compressor&) = delete;
+			Compressor& operator=(const Compressor&) = delete;
+
+			void end();
+		};
+	}
+}
+
+#endif //__COMPRESSION_HPP__
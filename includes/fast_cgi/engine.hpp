@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __ENGINE_HPP__
+#define __ENGINE_HPP__
+
+#include <fast_cgi/request.hpp>
+#include <fast_cgi/thread.hpp>
+#include <fast_cgi/protocol.hpp>
+#include <fast_cgi/scheduler.hpp>
+#include <mt.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		class EventEngine;
+		typedef std::shared_ptr<EventEngine> EventEnginePtr;
+		class EngineConnection;
+		typedef std::shared_ptr<EngineConnection> EngineConnectionPtr;
+
+		// A request collected by the engine. It is handed to a handler
+		// thread as soon as the params are complete; the stdin follows,
+		// while the handler reads it.
+		struct QueuedRequest
+		{
+			EngineConnectionPtr m_conn;
+			unsigned short m_id;
+			bool m_keepConn;
+			std::atomic<bool> m_aborted;
+			std::string m_params; // FCGI_PARAMS stream, decoded in place
+			size_t m_paramBytes; // as received, counted against the connection
+			std::vector<const char*> m_envp;
+
+			// stdin, not taken by the handler yet
+			std::mutex m_inputLock;
+			std::condition_variable m_inputReady;
+			std::string m_input;
+			bool m_inputEnd;
+			bool m_inputClosed; // the handler takes no more; the rest is thrown away
+
+			QueuedRequest(const EngineConnectionPtr& conn, unsigned short id, bool keepConn)
+				: m_conn(conn), m_id(id), m_keepConn(keepConn), m_aborted(false), m_paramBytes(0)
+				, m_inputEnd(false), m_inputClosed(false)
+			{
+			}
+
+			// engine thread
+			void feed(const char* data, size_t size);
+			void endInput();
+			void abort();
+			bool done(); // the handler takes no more stdin
+
+			// handler thread
+			bool take(std::string& chunk); // blocks for more; false, at the end of stdin
+			size_t closeInput(); // returns the bytes thrown away
+		};
+		typedef std::shared_ptr<QueuedRequest> QueuedRequestPtr;
+
+		// The socket is only closed by the engine thread; the handler
+		// threads write to it under the lock and leave whatever the
+		// socket would not take to the engine. Several requests may
+		// share the connection; their records are interleaved, but a
+		// record is never split by another one.
+		//
+		// Neither direction grows without a bound: the engine stops
+		// reading, while the handlers have too much stdin still to take,
+		// and a handler waits, while too much of the output is still to
+		// be sent. The stdin limit is per connection, so one request not
+		// reading its body would stall the others sharing the socket;
+		// hence, FCGI_MPXS_CONNS is reported as 0 and a web server asked
+		// not to multiplex (those which do anyway are still served).
+		class EngineConnection
+		{
+			friend class EventEngine;
+			friend struct QueuedRequest;
+
+			struct Chunk
+			{
+				const char* data;
+				size_t size;
+			};
+
+			EventEngine& m_engine;
+			int m_fd;
+			std::mutex m_lock;
+			std::condition_variable m_drained;
+			std::string m_output;
+			bool m_closed;
+			bool m_closeWhenSent;
+			bool m_wantOutput; // EPOLLOUT is on
+			bool m_paused; // EPOLLIN is off
+			std::unordered_map<unsigned short, QueuedRequestPtr> m_running; // handed to the handler threads
+			std::atomic<size_t> m_buffered; // stdin fed, but not taken
+			std::atomic<size_t> m_paramBytes; // params of all the requests still alive
+
+			// engine thread only
+			std::string m_input;
+			std::unordered_map<unsigned short, QueuedRequestPtr> m_receiving; // params or stdin still coming
+
+			void sendLocked(Chunk* chunks, size_t count);
+		public:
+			enum
+			{
+				MAX_BATCH = 32, // records in one sendmsg
+				MAX_REQUESTS = 100,
+				MAX_PARAMS_SIZE = 64 * 1024, // per request; larger ones get a 431
+				MAX_CONNECTION_PARAMS = 1024 * 1024, // all the requests together; then, a 503
+				INPUT_HIGH_WATER = 256 * 1024,
+				INPUT_LOW_WATER = 64 * 1024,
+				OUTPUT_HIGH_WATER = 256 * 1024,
+				OUTPUT_LOW_WATER = 64 * 1024
+			};
+
+			EngineConnection(EventEngine& engine, int fd)
+				: m_engine(engine), m_fd(fd), m_closed(false), m_closeWhenSent(false)
+				, m_wantOutput(false), m_paused(false), m_buffered(0), m_paramBytes(0)
+			{
+			}
+
+			void send(const char* data, size_t size); // whole records
+			void sendRecords(unsigned char type, unsigned short id, const char* data, size_t size);
+			void finished(const QueuedRequestPtr& request, const char* records, size_t size); // with the closing records
+
+			void pause(); // engine thread; only above the high-water mark
+			bool paused();
+			void consumed(size_t size); // handler thread; resumes the reading below the low-water mark
+		};
+
+		// Owns the listening socket and all of the connections from the
+		// web server; reads and parses the records on a single thread
+		// and hands the complete requests to the handler threads.
+		class EventEngine: public mt::Thread
+		{
+			friend class EngineConnection;
+
+			int m_listen;
+			int m_epoll;
+			int m_wakeup;
+			bool m_ownsListen;
+			bool m_listening; // false, while out of the descriptors
+			std::chrono::steady_clock::time_point m_retryAccept;
+			std::atomic<bool> m_stopping;
+			std::unordered_map<int, EngineConnectionPtr> m_connections;
+
+			Scheduler m_scheduler;
+
+			EventEngine(const EventEngine&) = delete;
+			EventEngine& operator=(const EventEngine&) = delete;
+
+			void acceptAll();
+			void listen(bool enable);
+			void readable(const EngineConnectionPtr& conn);
+			bool parse(const EngineConnectionPtr& conn); // false, if the connection was dropped
+			void writable(const EngineConnectionPtr& conn);
+			void drop(const EngineConnectionPtr& conn);
+			void watch(EngineConnection& conn); // under the lock of the connection
+			void record(const EngineConnectionPtr& conn, const protocol::Record& rec);
+			void beginRequest(const EngineConnectionPtr& conn, unsigned short id, const char* content, size_t length);
+			void abortRequest(const EngineConnectionPtr& conn, unsigned short id);
+			void refuse(const EngineConnectionPtr& conn, const QueuedRequestPtr& request, const char* status);
+			void handOver(const EngineConnectionPtr& conn, const QueuedRequestPtr& request);
+			void getValues(const EngineConnectionPtr& conn, const char* content, size_t length);
+			void push(const QueuedRequestPtr& request);
+		public:
+			enum
+			{
+				MAX_EVENTS = 64,
+				READ_CHUNK_SIZE = 64 * 1024,
+				MAX_READS = 4, // chunks read from one connection in a round
+				MAX_CONNECTIONS = 10000,
+				ACCEPT_BACKOFF = 1000 // ms, before accepting again with no descriptors to spare
+			};
+
+			EventEngine();
+			~EventEngine();
+
+			// "host:port" of a socket of its own, or the socket inherited
+			// from the spawner; false, where epoll is not available
+			bool open(const std::string& address);
+			void run() override;
+			void shutdown();
+
+			Scheduler& scheduler() { return m_scheduler; }
+		};
+
+		// Reads the stdin collected by the engine and sends the output
+		// as records of the request, straight from the caller's buffer;
+		// built once per handler thread.
+		class EngineRequest: public RequestBackend
+		{
+			struct InputBuffer: std::streambuf
+			{
+				QueuedRequestPtr m_request;
+				std::string m_chunk;
+				void reset(const QueuedRequestPtr& request);
+				void clear();
+				std::streamsize skip(std::streamsize size); // never waits; anything not arrived yet is thrown away
+			protected:
+				int_type underflow() override;
+			};
+
+			struct OutputBuffer: std::streambuf
+			{
+				EngineRequest& m_owner;
+				unsigned char m_type;
+				OutputBuffer(EngineRequest& owner, unsigned char type) : m_owner(owner), m_type(type) {}
+			protected:
+				int_type overflow(int_type ch) override;
+				std::streamsize xsputn(const char* data, std::streamsize size) override;
+			};
+
+			QueuedRequestPtr m_request;
+			InputBuffer m_inputBuffer;
+			OutputBuffer m_coutBuffer;
+			OutputBuffer m_cerrBuffer;
+			std::ostream m_cout;
+			std::ostream m_cerr;
+			std::istream m_cin;
+			bool m_errorsSent;
+		public:
+			EngineRequest();
+			void attach(const QueuedRequestPtr& request);
+			void finish();
+
+			std::ostream& cout() override { return m_cout; }
+			std::ostream& cerr() override { return m_cerr; }
+			std::istream& cin() override { return m_cin; }
+			std::streamsize read(char* buffer, std::streamsize size) override { return m_inputBuffer.sgetn(buffer, size); }
+			void write(const char* data, size_t size) override;
+			void flush() override {} // nothing is kept back
+			long long skip(long long size) override;
+
+			void send(unsigned char type, const char* data, size_t size);
+		};
+
+		class EngineThread: public ThreadBackend
+		{
+			EventEnginePtr m_engine; // outlives Application::run(), while the thread objects do
+			std::atomic<size_t> m_slot; // read by the pool controller
+			QueuedRequestPtr m_current;
+			EngineRequest m_requestBackend;
+		public:
+			explicit EngineThread(const EventEnginePtr& engine) : m_engine(engine), m_slot(Scheduler::NO_SLOT) {}
+			~EngineThread();
+			void init() override;
+			void retire() override { m_engine->scheduler().leave(m_slot); }
+			size_t queueDepth() const override { return m_engine->scheduler().depth(m_slot); }
+			const char * const* envp() const override;
+			bool accept() override;
+			void release() override;
+			void shutdown() override { m_engine->shutdown(); }
+			RequestBackend& requestBackend() override { return m_requestBackend; }
+		};
+	}
+}
+
+#endif //__ENGINE_HPP__
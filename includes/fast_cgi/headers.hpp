@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __HEADERS_HPP__
+#define __HEADERS_HPP__
+
+#include <vector>
+#include <fast_cgi/arena.hpp>
+#include <fast_cgi/param_view.hpp>
+
+namespace FastCGI
+{
+	enum HeaderId
+	{
+		HEADER_STATUS,
+		HEADER_CONTENT_TYPE,
+		HEADER_CONTENT_LENGTH,
+		HEADER_CONTENT_DISPOSITION,
+		HEADER_CONTENT_ENCODING,
+		HEADER_CONTENT_RANGE,
+		HEADER_LOCATION,
+		HEADER_LAST_MODIFIED,
+		HEADER_SET_COOKIE,
+		HEADER_CACHE_CONTROL,
+		HEADER_EXPIRES,
+		HEADER_ETAG,
+		HEADER_VARY,
+		HEADER_ACCEPT_RANGES,
+		HEADER_UNKNOWN
+	};
+
+	// Response headers, kept in the order they were first set. There is
+	// only a handful of them for any given response, so a flat vector
+	// searched by header id beats any map. Every entry is stored already
+	// serialized ("Name: value"), ready to be sent.
+	class ResponseHeaders
+	{
+		struct Header
+		{
+			HeaderId m_id;
+			size_t m_nameLength;
+			ArenaString m_line;
+
+			Header(HeaderId id, size_t nameLength, const ArenaAllocator<char>& alloc)
+				: m_id(id), m_nameLength(nameLength), m_line(alloc)
+			{
+			}
+			param_view line() const { return param_view(m_line.data(), m_line.length()); }
+			param_view value() const { return param_view(m_line.data() + m_nameLength + 2, m_line.length() - m_nameLength - 2); }
+		};
+		typedef std::vector<Header, ArenaAllocator<Header>> Storage;
+
+		ArenaAllocator<char> m_alloc;
+		Storage m_headers;
+
+		Header* find(HeaderId id, const char* name, size_t length);
+		const Header* find(HeaderId id) const;
+	public:
+		typedef Storage::const_iterator const_iterator;
+
+		explicit ResponseHeaders(const ArenaAllocator<char>& alloc);
+
+		static HeaderId lookup(const char* name, size_t length);
+		static const char* name(HeaderId id);
+
+		void set(HeaderId id, const char* value, size_t length);
+		void set(HeaderId id, const char* value) { set(id, value, strlen(value)); }
+		void set(const char* name, size_t nameLength, const char* value, size_t valueLength);
+		void set(HeaderId id, const char* name, size_t nameLength, const char* value, size_t valueLength); // id must come from lookup(name)
+		void remove(HeaderId id);
+		bool has(HeaderId id) const { return !!find(id); }
+		param_view get(HeaderId id) const;
+
+		const_iterator begin() const { return m_headers.begin(); }
+		const_iterator end() const { return m_headers.end(); }
+	};
+}
+
+#endif //__HEADERS_HPP__
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __HTTP_DATE_HPP__
+#define __HTTP_DATE_HPP__
+
+#include <utils.hpp>
+
+namespace FastCGI
+{
+	// Formats the dates for the response headers. Remembers the last
+	// value formatted, so a date repeated within the same second (e.g.
+	// "now + 30 days" of a session cookie) is formatted only once.
+	class HttpDate
+	{
+	public:
+		enum Style
+		{
+			RFC1123, // Sun, 06 Nov 1994 08:49:37 GMT
+			COOKIE   // Sun, 06-Nov-1994 08:49:37 GMT
+		};
+
+		explicit HttpDate(Style style = RFC1123) : m_style(style), m_time(0), m_length(0) { m_date[0] = 0; }
+
+		const char* format(tyme::time_t time)
+		{
+			if (!m_length || time != m_time)
+				update(time);
+			return m_date;
+		}
+		size_t length() const { return m_length; }
+	private:
+		Style m_style;
+		tyme::time_t m_time;
+		size_t m_length;
+		char m_date[32];
+
+		void update(tyme::time_t time);
+	};
+}
+
+#endif //__HTTP_DATE_HPP__
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __JSON_HPP__
+#define __JSON_HPP__
+
+#include <fast_cgi/response_buffer.hpp>
+#include <stdint.h>
+
+namespace FastCGI
+{
+	class Request;
+
+	// Writes JSON straight into the response buffer; the commas and
+	// the colons are put in by the writer:
+	//
+	//     JsonWriter json(request);
+	//     json.beginObject()
+	//         .member("id", id)
+	//         .key("tags").beginArray();
+	//     for (auto&& tag : tags)
+	//         json.value(tag);
+	//     json.endArray()
+	//         .endObject();
+	//
+	// Strings are escaped in runs; nothing is allocated per value.
+	class JsonWriter
+	{
+		ResponseBuffer& m_out;
+		uint64_t m_hasItems; // bit per nesting level
+		unsigned m_depth;
+		unsigned m_refused; // levels opened past MAX_DEPTH
+		bool m_afterKey;
+
+		bool separate(); // false, inside a refused level
+		JsonWriter& open(char c);
+		JsonWriter& close(char c);
+		void string(const char* data, size_t size);
+		JsonWriter& integer(long long value) { if (separate()) m_out.append(value); return *this; }
+		JsonWriter& integer(unsigned long long value) { if (separate()) m_out.append(value); return *this; }
+	public:
+		// The commas are tracked for that many levels. Deeper, debug builds
+		// assert; otherwise, the array or object is written as a null and
+		// everything put into it is dropped, so the output stays valid JSON.
+		enum { MAX_DEPTH = 64 };
+
+		// sets the Content-Type, unless the handler already did
+		explicit JsonWriter(Request& request);
+		explicit JsonWriter(ResponseBuffer& out);
+
+		JsonWriter& beginObject() { return open('{'); }
+		JsonWriter& endObject() { return close('}'); }
+		JsonWriter& beginArray() { return open('['); }
+		JsonWriter& endArray() { return close(']'); }
+
+		JsonWriter& key(const param_view& name);
+
+		JsonWriter& value(const param_view& value) { if (separate()) string(value.data(), value.size()); return *this; }
+		JsonWriter& value(const char* value) { if (!value) return null(); return this->value(param_view(value)); }
+		JsonWriter& value(bool value);
+		JsonWriter& value(int value) { return integer((long long)value); }
+		JsonWriter& value(unsigned int value) { return integer((unsigned long long)value); }
+		JsonWriter& value(long value) { return integer((long long)value); }
+		JsonWriter& value(unsigned long value) { return integer((unsigned long long)value); }
+		JsonWriter& value(long long value) { return integer(value); }
+		JsonWriter& value(unsigned long long value) { return integer(value); }
+		JsonWriter& value(double value);
+		JsonWriter& null();
+
+		// already serialized JSON, e.g. from a cache
+		JsonWriter& raw(const param_view& json) { if (separate()) m_out.append(json); return *this; }
+
+		template <typename T>
+		JsonWriter& member(const param_view& name, const T& value)
+		{
+			key(name);
+			return this->value(value);
+		}
+	};
+}
+
+#endif //__JSON_HPP__
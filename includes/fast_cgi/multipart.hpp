@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __MULTIPART_HPP__
+#define __MULTIPART_HPP__
+
+#include <memory>
+#include <string>
+#include <stdio.h>
+
+namespace FastCGI
+{
+	struct UploadInfo
+	{
+		std::string name;        // name of the form field
+		std::string filename;    // name of the file on the client side
+		std::string contentType;
+	};
+
+	// Receives the contents of the file parts of a multipart/form-data
+	// body, one part at a time, as the body is read from the server.
+	struct UploadSink
+	{
+		virtual ~UploadSink() {}
+		virtual bool open(const UploadInfo& info) = 0;
+		virtual bool write(const char* data, size_t size) = 0;
+		virtual void close() = 0;
+	};
+	using UploadSinkPtr = std::shared_ptr<UploadSink>;
+
+	class UploadedFile
+	{
+		UploadInfo m_info;
+		std::string m_path;
+		unsigned long long m_size;
+		bool m_owned;
+	public:
+		UploadedFile(const UploadInfo& info, const std::string& path)
+			: m_info(info), m_path(path), m_size(0), m_owned(!path.empty())
+		{
+		}
+		~UploadedFile();
+
+		const std::string& name() const { return m_info.name; }
+		const std::string& filename() const { return m_info.filename; }
+		const std::string& contentType() const { return m_info.contentType; }
+		const std::string& path() const { return m_path; } // empty, if a custom sink was used
+		unsigned long long size() const { return m_size; }
+		void grow(size_t size) { m_size += size; }
+
+		// The temporary file is removed with the request, unless it
+		// is moved somewhere else.
+		bool saveAs(const std::string& path);
+	};
+	using UploadedFilePtr = std::shared_ptr<UploadedFile>;
+
+	namespace impl
+	{
+		struct MultipartHandler
+		{
+			virtual ~MultipartHandler() {}
+			virtual bool onField(const std::string& name, const std::string& value) = 0;
+			virtual bool onFileOpen(const UploadInfo& info) = 0;
+			virtual bool onFileData(const char* data, size_t size) = 0;
+			virtual void onFileClose() = 0;
+		};
+
+		// Push parser for RFC 2388 bodies. Only the trailing part of a
+		// chunk, which may hold the beginning of a boundary, is kept
+		// between feed() calls; file contents go straight to the handler.
+		class MultipartParser
+		{
+			enum State
+			{
+				PREAMBLE,
+				AFTER_BOUNDARY,
+				HEADERS,
+				BODY,
+				EPILOGUE,
+				FAILED
+			};
+
+			MultipartHandler& m_handler;
+			std::string m_delimiter; // CRLF "--" boundary
+			std::string m_buffer;
+			size_t m_maxFieldSize;
+			size_t m_maxHeaderSize;
+			State m_state;
+			bool m_tooLarge; // failed on a limit, not on the syntax
+			bool m_isFile;
+			bool m_skip; // file field with no file chosen
+			UploadInfo m_part;
+			std::string m_field;
+
+			bool parseHeaders(const char* data, size_t size);
+			bool partData(const char* data, size_t size);
+			bool partEnd();
+		public:
+			enum
+			{
+				DEFAULT_MAX_FIELD_SIZE = 64 * 1024,
+				DEFAULT_MAX_HEADER_SIZE = 8 * 1024
+			};
+
+			MultipartParser(const std::string& boundary, MultipartHandler& handler, size_t maxFieldSize = DEFAULT_MAX_FIELD_SIZE);
+
+			bool feed(const char* data, size_t size);
+			bool finished() const { return m_state == EPILOGUE; }
+			bool failed() const { return m_state == FAILED; }
+			bool tooLarge() const { return m_tooLarge; }
+
+			static std::string boundary(const char* contentType);
+		};
+
+		// default sink, streams the files into temporary files
+		class TempFileSink: public UploadSink
+		{
+			FILE* m_file;
+			std::string m_path;
+		public:
+			TempFileSink() : m_file(nullptr) {}
+			~TempFileSink() { close(); }
+			bool open(const UploadInfo& info) override;
+			bool write(const char* data, size_t size) override;
+			void close() override;
+			const std::string& path() const { return m_path; }
+		};
+	}
+}
+
+#endif //__MULTIPART_HPP__
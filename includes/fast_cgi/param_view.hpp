@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __PARAM_VIEW_HPP__
+#define __PARAM_VIEW_HPP__
+
+#include <string>
+#include <ostream>
+#include <string.h>
+
+namespace FastCGI
+{
+	// Non-owning, not necessarily NUL-terminated, piece of a request
+	// (environment, cookie header or body). Valid until the request ends.
+	class param_view
+	{
+		const char* m_data;
+		size_t m_size;
+	public:
+		param_view() : m_data(nullptr), m_size(0) {}
+		param_view(const char* data) : m_data(data), m_size(data ? strlen(data) : 0) {}
+		param_view(const char* data, size_t size) : m_data(data), m_size(size) {}
+		param_view(const std::string& s) : m_data(s.data()), m_size(s.length()) {}
+
+		const char* data() const { return m_data; }
+		size_t size() const { return m_size; }
+		size_t length() const { return m_size; }
+		bool empty() const { return !m_size; }
+		bool null() const { return !m_data; } // variable or cookie was not sent at all
+
+		const char* begin() const { return m_data; }
+		const char* end() const { return m_data + m_size; }
+		char operator[](size_t pos) const { return m_data[pos]; }
+
+		std::string str() const { return m_data ? std::string(m_data, m_size) : std::string(); }
+
+		int compare(const param_view& rhs) const
+		{
+			size_t len = m_size < rhs.m_size ? m_size : rhs.m_size;
+			int ret = len ? memcmp(m_data, rhs.m_data, len) : 0;
+			if (ret)
+				return ret;
+			return m_size < rhs.m_size ? -1 : (m_size > rhs.m_size ? 1 : 0);
+		}
+	};
+
+	inline bool operator == (const param_view& lhs, const param_view& rhs) { return lhs.size() == rhs.size() && !lhs.compare(rhs); }
+	inline bool operator != (const param_view& lhs, const param_view& rhs) { return !(lhs == rhs); }
+	inline bool operator < (const param_view& lhs, const param_view& rhs) { return lhs.compare(rhs) < 0; }
+
+	inline std::ostream& operator << (std::ostream& o, const param_view& view)
+	{
+		return o.write(view.data(), view.size());
+	}
+}
+
+#endif //__PARAM_VIEW_HPP__
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __POOL_HPP__
+#define __POOL_HPP__
+
+#include <mt.hpp>
+#include <condition_variable>
+#include <mutex>
+
+namespace FastCGI
+{
+	class Application;
+
+	namespace impl
+	{
+		// Looks at the threads of the application once per interval.
+		// Starts new ones while they are all busy or the requests wait
+		// for them, and lets one go after a longer idle spell.
+		class PoolController: public mt::Thread
+		{
+			Application& m_app;
+			std::mutex m_lock;
+			std::condition_variable m_wake;
+			bool m_stopping;
+			size_t m_idleSamples;
+
+			PoolController(const PoolController&) = delete;
+			PoolController& operator=(const PoolController&) = delete;
+
+			size_t reap(unsigned long& load); // live threads, with their mean load
+			void grow(size_t live);
+			void shrink();
+		public:
+			enum
+			{
+				SAMPLE_INTERVAL = 1000, // ms
+				HIGH_LOAD = 85, // percent, mean of all the threads
+				LOW_LOAD = 25,
+				MAX_QUEUE_WAIT = 20000, // us, mean of the requests taken in the last interval
+				IDLE_SAMPLES = 30 // low load, before a thread is let go
+			};
+
+			explicit PoolController(Application& app);
+
+			void adjust();
+			void run() override;
+			void shutdown();
+		};
+	}
+}
+
+#endif //__POOL_HPP__
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __PROTOCOL_HPP__
+#define __PROTOCOL_HPP__
+
+#include <string>
+#include <vector>
+#include <string.h>
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		namespace protocol
+		{
+			enum
+			{
+				VERSION_1 = 1,
+				HEADER_SIZE = 8,
+				MAX_CONTENT = 0xFFF8, // the largest multiple of 8 a record can hold
+
+				// record types
+				BEGIN_REQUEST = 1,
+				ABORT_REQUEST = 2,
+				END_REQUEST = 3,
+				PARAMS = 4,
+				STDIN = 5,
+				STDOUT = 6,
+				STDERR = 7,
+				GET_VALUES = 9,
+				GET_VALUES_RESULT = 10,
+				UNKNOWN_TYPE = 11,
+
+				// BEGIN_REQUEST
+				RESPONDER = 1,
+				KEEP_CONN = 1,
+
+				// END_REQUEST
+				REQUEST_COMPLETE = 0,
+				CANT_MPX_CONN = 1,
+				OVERLOADED = 2,
+				UNKNOWN_ROLE = 3
+			};
+
+			struct Record
+			{
+				unsigned char type;
+				unsigned short id;
+				const char* content;
+				size_t length;
+			};
+
+			enum ReadResult
+			{
+				RECORD,
+				PARTIAL,  // wait for more data
+				MALFORMED // not a FastCGI peer; drop the connection
+			};
+
+			// Looks at the front of the data; the record, if whole, points
+			// into it and takes "consumed" bytes, padding included.
+			ReadResult readRecord(const char* data, size_t size, Record& record, size_t& consumed);
+
+			inline void recordHeader(unsigned char* out, unsigned char type, unsigned short id, size_t length)
+			{
+				out[0] = VERSION_1;
+				out[1] = type;
+				out[2] = (unsigned char)(id >> 8);
+				out[3] = (unsigned char)id;
+				out[4] = (unsigned char)(length >> 8);
+				out[5] = (unsigned char)length;
+				out[6] = 0;
+				out[7] = 0;
+			}
+
+			// header and body of an END_REQUEST
+			inline void endRequest(unsigned char* out, unsigned short id, unsigned char status)
+			{
+				recordHeader(out, END_REQUEST, id, 8);
+				memset(out + HEADER_SIZE, 0, 8);
+				out[HEADER_SIZE + 4] = status;
+			}
+
+			// Rewrites the PARAMS stream into "NAME=value\0" strings in
+			// the same buffer; an entry never grows, so it never runs into
+			// the ones not read yet. The envp points into the params and
+			// ends with a nullptr.
+			bool decodeParams(std::string& params, std::vector<const char*>& envp);
+
+			// Goes over the name-value pairs of a GET_VALUES, without the values.
+			bool nextName(const char*& data, const char* end, const char*& name, size_t& length);
+			void appendNameValue(std::string& out, const char* name, size_t nameLength, const std::string& value);
+		}
+	}
+}
+
+#endif //__PROTOCOL_HPP__
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __RANGES_HPP__
+#define __RANGES_HPP__
+
+#include <fast_cgi/response_buffer.hpp>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+namespace FastCGI
+{
+	// Seekable content for Request::sendRanges(); only the slices
+	// asked for by the browser are ever written to the output.
+	class RangeSource
+	{
+	public:
+		virtual ~RangeSource() {}
+		virtual unsigned long long size() const = 0;
+		virtual bool send(ResponseBuffer& out, unsigned long long offset, unsigned long long length) = 0;
+	};
+
+	class MemorySource: public RangeSource
+	{
+		const char* m_data;
+		size_t m_size;
+	public:
+		MemorySource(const char* data, size_t size) : m_data(data), m_size(size) {}
+		explicit MemorySource(const std::string& data) : m_data(data.data()), m_size(data.length()) {}
+		unsigned long long size() const override { return m_size; }
+		bool send(ResponseBuffer& out, unsigned long long offset, unsigned long long length) override;
+	};
+
+	// Read in chunks, as the slices are sent; a file which shrinks
+	// meanwhile fails the send, instead of crashing the process.
+	class FileSource: public RangeSource
+	{
+#ifdef _WIN32
+		FILE* m_file;
+#else
+		int m_fd;
+#endif
+		unsigned long long m_size;
+
+		FileSource(const FileSource&) = delete;
+		FileSource& operator=(const FileSource&) = delete;
+	public:
+		enum
+		{
+			READ_CHUNK_SIZE = 32 * 1024
+		};
+
+		FileSource();
+		~FileSource();
+		bool open(const std::string& path);
+		void close();
+		bool isOpen() const;
+		unsigned long long size() const override { return m_size; }
+		bool send(ResponseBuffer& out, unsigned long long offset, unsigned long long length) override;
+	};
+
+	namespace impl
+	{
+		struct ByteRange
+		{
+			unsigned long long first;
+			unsigned long long last; // inclusive, as in the Content-Range
+			unsigned long long length() const { return last - first + 1; }
+		};
+
+		// "bytes=0-499,1000-", "bytes=-500", ...; overlapping and adjacent
+		// ranges are merged, so a slice is never sent twice.
+		class ByteRanges
+		{
+			std::vector<ByteRange> m_ranges;
+		public:
+			enum Result
+			{
+				WHOLE,        // no header, an invalid one or too many ranges
+				PARTIAL,
+				UNSATISFIABLE
+			};
+
+			enum { MAX_RANGES = 16 };
+
+			Result parse(const char* header, unsigned long long size);
+			const std::vector<ByteRange>& ranges() const { return m_ranges; }
+			size_t count() const { return m_ranges.size(); }
+			const ByteRange& operator[](size_t pos) const { return m_ranges[pos]; }
+		};
+	}
+}
+
+#endif //__RANGES_HPP__
@@ -33,6 +33,11 @@
 #include <format.hpp>
 
 #include <fast_cgi/thread.hpp>
+#include <fast_cgi/param_view.hpp>
+#include <fast_cgi/multipart.hpp>
+#include <fast_cgi/response_buffer.hpp>
+#include <fast_cgi/headers.hpp>
+#include <fast_cgi/ranges.hpp>
 
 namespace lng
 {
@@ -47,6 +52,7 @@ namespace FastCGI
 {
 #define HTTP_X_AJAX_FRAGMENT "HTTP_X_AJAX_FRAGMENT"
 #define ATTR_X_AJAX_FRAGMENT "x-ajax-fragment"
+#define SESSION_COOKIE "reader.login"
 
 
 	class Application;
@@ -58,11 +64,14 @@ namespace FastCGI
 
 	namespace impl
 	{
-		struct RequestBackend
+		struct RequestBackend: ResponseSink
 		{
 			virtual std::ostream& cout() = 0;
 			virtual std::ostream& cerr() = 0;
 			virtual std::istream& cin() = 0;
+			virtual std::streamsize read(char* buffer, std::streamsize size) = 0; // bypasses cin()
+			virtual void flush() = 0;
+			virtual long long skip(long long size) = 0; // negative size skips up to the end of input; returns the number of bytes skipped (a backend may drop what has not arrived yet, without waiting for it)
 		};
 	};
 
@@ -131,49 +140,155 @@ namespace FastCGI
 	};
 
 	class static_resources_t {};
+	struct RequestMultipart;
+	struct VariableTarget;
 	class Request
 	{
-		typedef std::map<std::string, std::string> Headers;
+		friend class Thread;
+		friend struct RequestMultipart;
+		friend struct VariableTarget;
 
+		// all of the per-request containers use the thread's arena
 		struct Cookie
 		{
-			std::string m_name;
-			std::string m_value;
+			typedef ArenaAllocator<char> allocator_type;
+
+			ArenaString m_name;
+			ArenaString m_value;
 			tyme::time_t m_expire;
 
-			Cookie(): m_expire(0) {}
-			Cookie(const std::string& name, const std::string& value, tyme::time_t expire)
-				: m_name(name)
-				, m_value(value)
+			explicit Cookie(const allocator_type& alloc = allocator_type())
+				: m_name(alloc), m_value(alloc), m_expire(0) {}
+			Cookie(const std::string& name, const std::string& value, tyme::time_t expire, const allocator_type& alloc = allocator_type())
+				: m_name(name.data(), name.length(), alloc)
+				, m_value(value.data(), value.length(), alloc)
 				, m_expire(expire)
 			{}
+			Cookie(const Cookie& other, const allocator_type& alloc)
+				: m_name(other.m_name, alloc)
+				, m_value(other.m_value, alloc)
+				, m_expire(other.m_expire)
+			{}
+			Cookie(const Cookie&) = default;
+		};
+		typedef ArenaMap<ArenaString, Cookie> ResponseCookies;
+
+		// Variable or cookie value, as sent by the client. Decoding and
+		// NUL-terminating is postponed until someone asks for the value.
+		struct RequestValue
+		{
+			mutable param_view m_value;
+			mutable const char* m_cstr;
+			mutable bool m_escaped;
+
+			RequestValue() : m_cstr(nullptr), m_escaped(false) {}
+			RequestValue(const param_view& value, bool escaped) : m_value(value), m_cstr(nullptr), m_escaped(escaped) {}
+		};
+		typedef ArenaMap<param_view, RequestValue> RequestCookies;
+		typedef ArenaMap<param_view, RequestValue> RequestVariables;
+
+		// Open-addressed hash of the CGI environment, built on the first
+		// getParam(); the slots point straight into envp.
+		struct ParamSlot
+		{
+			const char* m_name;
+			size_t m_length;
+			const char* m_value;
+		};
+
+		// Receives the contents of the thread's response buffer; sends
+		// the headers before the first piece of the body.
+		struct OutputSink: ResponseSink
+		{
+			Request& m_request;
+			explicit OutputSink(Request& request) : m_request(request) {}
+			void write(const char* data, size_t size) override { m_request.sendOutput(data, size, false); }
+			void finish(const char* data, size_t size) override { m_request.sendOutput(data, size, true); }
 		};
-		typedef std::map<std::string, Cookie> ResponseCookies;
-		typedef std::map<std::string, std::string> RequestCookies;
-		typedef std::map<std::string, std::string> RequestVariables;
 
 		Thread& m_thread;
-		bool m_headersSent;
-		Headers m_headers;
+		bool m_headersSent; // no more changes to the headers, they will be sent with the first flush
+		bool m_headersWritten;
+		bool m_compressionAllowed;
+		bool m_compressing;
+		bool m_flushAfterHead;
+		bool m_autoETag;
+		size_t m_headScanned;
+		OutputSink m_sink;
+		ResponseHeaders m_headers;
 		ResponseCookies m_respCookies;
-		RequestCookies m_reqCookies;
-		RequestVariables m_reqVars;
+		mutable RequestCookies m_reqCookies;
+		mutable RequestVariables m_reqVars;
 		mutable bool m_alreadyReadSomething;
+		mutable bool m_inputUnknown; // read through cin(), so the position is unknown
+		long long m_bytesRead;
+		mutable bool m_cookiesUnpacked;
+		mutable bool m_bodyUnpacked;
+		mutable bool m_queryUnpacked;
+		mutable int m_formRejected; // 400 or 413, for a form not taken
+		mutable ParamSlot* m_params;
+		mutable size_t m_paramsMask;
+		bool m_uploadsAllowed;
+		UploadSinkPtr m_uploadSink;
+		std::list<UploadedFilePtr> m_uploads;
 		RequestStatePtr m_requestState;
 		ContentPtr m_content;
-		std::shared_ptr<impl::RequestBackend> m_backend;
+		impl::RequestBackend* m_backend; // owned by the thread
 		std::string m_https_staticResources;
 #if DEBUG_CGI
 		std::string m_icicle;
 #endif
 
-		void unpackCookies();
-		void unpackVariables(const char* data, size_t len);
-		void unpackVariables();
+		ArenaAllocator<char> allocator() const { return ArenaAllocator<char>(&m_thread.m_arena); }
+		char* arenaBuffer(size_t size) const { return static_cast<char*>(m_thread.m_arena.allocate(size, 1)); }
+		param_view unescaped(const char* data, size_t len) const;
+		param_view arenaCopy(const char* data, size_t len) const;
+		param_view decoded(const char* data, size_t len) const;
+		param_view value(const RequestValue& value) const;
+		param_t c_str(const RequestValue& value) const;
+		void indexParams() const;
+		void unpackCookies() const;
+		void unpackVariables(const char* data, size_t len) const;
+		void unpackBody();
+		void unpackMultipart(const char* contentType);
+		void addVariable(const std::string& name, const std::string& value) const;
+		void addEncodedVariable(const char* name, size_t nameLength, bool nameEscaped,
+			const char* value, size_t valueLength, bool valueEscaped, bool copy) const;
+		void unpackQuery() const;
+
+		// cookies and variables are parsed on first use only
+		void ensureCookies() const
+		{
+			if (!m_cookiesUnpacked)
+				unpackCookies();
+		}
+		void unpackVariables() const
+		{
+			// the body goes first, so the query string overrides the form
+			if (!m_bodyUnpacked)
+				const_cast<Request*>(this)->unpackBody();
+			if (!m_queryUnpacked)
+				unpackQuery();
+		}
+		void rejectForm(int status = 413);
+		void answerForm();
+		void answerRejectedForm(); // after the handler, if there was no output to do it
 		void readAll();
+		// parses the form, while the input is still there, and answers
+		// the form over the limits with a 413
 		void ensureInputWasRead();
+		const std::string& cookieSuffix();
 		void buildCookieHeader();
-		void printHeaders();
+		void commitHeaders();
+		void startCompression(size_t size, bool last);
+		void writeHeaders();
+		void sendOutput(const char* data, size_t size, bool last);
+		void lookForHead();
+		void errorPage(int status, const char* statusLine, const char* reason);
+		bool autoETag(const char* data, size_t size);
+		bool notModified(const param_view& etag);
+		bool rangeStillValid();
+		bool headRequest();
 
 	public:
 		std::ostream& cerr() { return m_backend->cerr(); }
@@ -192,20 +307,64 @@ namespace FastCGI
 		db::ConnectionPtr dbConn() { return m_thread.dbConn(*this); }
 
 		void setHeader(const std::string& name, const std::string& value);
+		void setHeader(HeaderId id, const char* value);
+		bool hasHeader(HeaderId id) const { return m_headers.has(id); }
 		void setCookie(const std::string& name, const std::string& value, tyme::time_t expire = 0);
 		long long calcStreamSize();
-		param_t getParam(const char* name) const { return FCGX_GetParam(name, (char**)envp()); }
+		param_t getParam(const char* name) const;
 		param_t getCookie(const char* name) const {
+			ensureCookies();
 			RequestCookies::const_iterator _it = m_reqCookies.find(name);
 			if (_it == m_reqCookies.end())
 				return nullptr;
-			return _it->second.c_str();
+			return c_str(_it->second);
 		}
 		param_t getVariable(const char* name) const {
+			unpackVariables();
 			RequestVariables::const_iterator _it = m_reqVars.find(name);
 			if (_it == m_reqVars.end())
 				return nullptr;
-			return _it->second.c_str();
+			return c_str(_it->second);
+		}
+
+		// Zero-copy versions of the above; unless the value had to be
+		// decoded, the view points straight into the request data.
+		// Missing values are reported as null() views.
+		param_view getCookieView(const param_view& name) const {
+			ensureCookies();
+			RequestCookies::const_iterator _it = m_reqCookies.find(name);
+			if (_it == m_reqCookies.end())
+				return param_view();
+			return value(_it->second);
+		}
+		param_view getVariableView(const param_view& name) const {
+			unpackVariables();
+			RequestVariables::const_iterator _it = m_reqVars.find(name);
+			if (_it == m_reqVars.end())
+				return param_view();
+			return value(_it->second);
+		}
+
+		// Multipart bodies are only parsed for handlers, which allow uploads.
+		// Unless a sink is given, files are kept in temporary files, which
+		// are removed together with the request.
+		void allowUploads(bool allow = true) { m_uploadsAllowed = allow; }
+		void allowCompression(bool allow = true) { m_compressionAllowed = allow; }
+		void setUploadSink(const UploadSinkPtr& sink) { m_uploadSink = sink; }
+		UploadedFilePtr getUpload(const char* name) const
+		{
+			unpackVariables();
+			for (auto&& upload : m_uploads)
+			{
+				if (upload->name() == name)
+					return upload;
+			}
+			return nullptr;
+		}
+		const std::list<UploadedFilePtr>& getUploads() const
+		{
+			unpackVariables();
+			return m_uploads;
 		}
 
 		void die() { throw FinishResponse(); }
@@ -217,9 +376,24 @@ namespace FastCGI
 			redirectUrl(serverUri(resource, withQuery));
 		}
 
+		// Answers with 304, if the browser has it since; ignored when the
+		// browser sent an If-None-Match, which only onETag() may answer.
 		void onLastModified(tyme::time_t lastModified);
+		// For content with a cheap version key: answers with 304 and
+		// ends the request if the browser already has this version.
+		void onETag(const std::string& key);
+		// Hashes the body into the ETag and skips sending it altogether,
+		// if the browser already has it. Only works for responses, which
+		// fit in the output buffer and were not flushed explicitly.
+		void useAutoETag(bool enable = true) { m_autoETag = enable; }
+		// Sends the source, or only the parts of it listed in the Range
+		// header (206, multipart/byteranges for more than one range).
+		// Call after the Content-Type and the validators were set, so the
+		// If-Range can be checked against them.
+		void sendRanges(RangeSource& source);
 		void on400(const char* reason = nullptr);
 		void on404();
+		void on413();
 		void __on500(const char* file, int line, const std::string& log);
 
 		const std::string& getStaticResources();
@@ -238,17 +412,38 @@ namespace FastCGI
 		ContentPtr getContent() { return m_content; }
 		void setContent(const ContentPtr& content) { m_content = content; }
 
-		std::ostream& cout()
+		ResponseBuffer& output()
+		{
+			if (!m_headersSent)
+			{
+				ensureInputWasRead();
+				commitHeaders();
+			}
+			// catches up with whatever went through cout() since
+			if (m_flushAfterHead)
+				lookForHead();
+			return m_thread.m_output;
+		}
+
+		// Called after each fragment is appended to the output.
+		void written()
 		{
-			ensureInputWasRead();
-			printHeaders();
-			return m_backend->cout();
+			if (m_flushAfterHead)
+				lookForHead();
 		}
 
+		// Sends everything written so far to the browser.
+		void flush();
+		// Flushes as soon as the </head> is written, so the browser may
+		// fetch the styles and scripts while the rest of the page is built.
+		void flushAfterHead(bool enable = true) { m_flushAfterHead = enable; }
+		std::ostream& cout() { return output().stream(); }
+
 		template <typename T>
 		const Request& operator >> (T& obj) const
 		{
 			m_alreadyReadSomething = true;
+			m_inputUnknown = true;
 			m_backend->cin() >> obj;
 			return *this;
 		}
@@ -256,14 +451,17 @@ namespace FastCGI
 		std::streamsize read(void* ptr, std::streamsize length)
 		{
 			m_alreadyReadSomething = true;
-			m_backend->cin().read((char*)ptr, length);
-			return m_backend->cin().gcount();
+			std::streamsize got = m_backend->read((char*)ptr, length);
+			if (got > 0)
+				m_bytesRead += got;
+			return got;
 		}
 
 		template<std::streamsize length>
 		std::streamsize read(char* (&ptr)[length])
 		{
 			m_alreadyReadSomething = true;
+			m_inputUnknown = true;
 			m_backend->cin().read(ptr, length);
 			return m_backend->cin().gcount();
 		}
@@ -271,11 +469,19 @@ namespace FastCGI
 		bool forAjaxFragment() const { return !!getParam(HTTP_X_AJAX_FRAGMENT); }
 
 #if DEBUG_CGI
-		const std::map<std::string, std::string>& cookieDebugData() const {
-			return m_reqCookies;
+		std::map<std::string, std::string> cookieDebugData() const {
+			ensureCookies();
+			return debugData(m_reqCookies);
+		}
+		std::map<std::string, std::string> varDebugData() const {
+			unpackVariables();
+			return debugData(m_reqVars);
 		}
-		const std::map<std::string, std::string>& varDebugData() const {
-			return m_reqVars;
+		std::map<std::string, std::string> debugData(const ArenaMap<param_view, RequestValue>& data) const {
+			std::map<std::string, std::string> out;
+			for (auto&& pair : data)
+				out[pair.first.str()] = value(pair.second).str();
+			return out;
 		}
 
 		void setIcicle(const std::string& icicle) { m_icicle = icicle; }
@@ -283,11 +489,12 @@ namespace FastCGI
 #endif
 	};
 
-	inline std::ostream& req_ostream(Request& r) { return r.cout(); }
+	inline ResponseBuffer& req_output(Request& r) { return r.output(); }
+	inline void req_written(Request& r) { r.written(); }
 
 #ifndef REQUEST_OSTREAM
 #define REQUEST_OSTREAM
-	template <typename T> inline Request& operator << (Request& r, T&& in) { req_ostream(r) << in; return r; }
+	template <typename T> inline Request& operator << (Request& r, T&& in) { req_output(r) << in; req_written(r); return r; }
 #endif
 
 	inline Request& operator << (Request& r, static_resources_t)
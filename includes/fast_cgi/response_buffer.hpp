@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __RESPONSE_BUFFER_HPP__
+#define __RESPONSE_BUFFER_HPP__
+
+#include <streambuf>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <fast_cgi/param_view.hpp>
+
+namespace FastCGI
+{
+	// Final destination of the response bytes
+	struct ResponseSink
+	{
+		virtual ~ResponseSink() {}
+		virtual void write(const char* data, size_t size) = 0;
+		virtual void finish(const char* data, size_t size) { if (size) write(data, size); } // the last piece of the response
+	};
+
+	// Append-only byte buffer collecting the whole response. Strings and
+	// numbers are copied straight in; everything else is formatted by an
+	// std::ostream writing into the very same buffer. The contents are
+	// handed to the sink in one piece, when the buffer is flushed, or
+	// when it grows over the flush threshold.
+	class ResponseBuffer: public std::streambuf
+	{
+		char* m_data;
+		size_t m_capacity;
+		size_t m_flushThreshold;
+		size_t m_flushed;
+		ResponseSink* m_sink;
+		std::ostream m_stream;
+
+		ResponseBuffer(const ResponseBuffer&) = delete;
+		ResponseBuffer& operator=(const ResponseBuffer&) = delete;
+
+		void setUsed(size_t used);
+		char* room(size_t size);
+		bool plainNumbers() const { return m_stream.flags() == (std::ios_base::dec | std::ios_base::skipws); }
+	protected:
+		int_type overflow(int_type ch) override;
+		std::streamsize xsputn(const char* data, std::streamsize size) override;
+	public:
+		enum
+		{
+			DEFAULT_CAPACITY = 16 * 1024,
+			DEFAULT_FLUSH_THRESHOLD = 256 * 1024,
+			DIRECT_CHUNK_SIZE = 1024 * 1024
+		};
+
+		ResponseBuffer();
+		~ResponseBuffer();
+
+		// the buffer is emptied and the formatting flags are reset for each request
+		void attach(ResponseSink* sink);
+		void detach();
+		void flush();
+
+		const char* data() const { return pbase(); }
+		size_t size() const { return (size_t)(pptr() - pbase()); }
+		bool empty() const { return pptr() == pbase(); }
+		size_t flushed() const { return m_flushed; } // bytes already handed to the sink
+		void clear() { setUsed(0); }
+
+		void append(const char* data, size_t size);
+		void append(const param_view& view) { append(view.data(), view.size()); }
+		void append(char c) { *room(1) = c; }
+		void append(long long value);
+		void append(unsigned long long value);
+		void append(double value);
+
+		// formats the number just like the stream would; unless the
+		// stream was told otherwise, skips the std::ostream machinery
+		template <typename T>
+		void number(T value)
+		{
+			typedef typename std::conditional<std::is_floating_point<T>::value, double,
+				typename std::conditional<std::is_signed<T>::value, long long, unsigned long long>::type>::type plain_t;
+
+			if (!plainNumbers() || (std::is_floating_point<T>::value && m_stream.precision() != 6))
+				m_stream << value;
+			else
+				append(static_cast<plain_t>(value));
+		}
+
+		std::ostream& stream() { return m_stream; }
+	};
+
+	inline ResponseBuffer& operator << (ResponseBuffer& out, const char* s) { if (s) out.append(s, strlen(s)); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, const param_view& s) { out.append(s); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, char c) { out.append(c); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, short value) { out.number(value); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, unsigned short value) { out.number(value); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, int value) { out.number(value); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, unsigned int value) { out.number(value); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, long value) { out.number(value); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, unsigned long value) { out.number(value); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, long long value) { out.number(value); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, unsigned long long value) { out.number(value); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, float value) { out.number(value); return out; }
+	inline ResponseBuffer& operator << (ResponseBuffer& out, double value) { out.number(value); return out; }
+
+	template <typename Alloc>
+	inline ResponseBuffer& operator << (ResponseBuffer& out, const std::basic_string<char, std::char_traits<char>, Alloc>& s)
+	{
+		out.append(s.data(), s.length());
+		return out;
+	}
+
+	template <typename T>
+	inline ResponseBuffer& operator << (ResponseBuffer& out, const T& value)
+	{
+		out.stream() << value;
+		return out;
+	}
+}
+
+#endif //__RESPONSE_BUFFER_HPP__
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SCHEDULER_HPP__
+#define __SCHEDULER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		struct QueuedRequest;
+		typedef std::shared_ptr<QueuedRequest> QueuedRequestPtr;
+
+		// Every handler thread has a queue of its own. The engine puts a
+		// new request on the shortest one; a thread with nothing left in
+		// its queue takes the oldest request of the longest queue, so a
+		// request is never stuck behind a slow one while another thread
+		// is idle.
+		class Scheduler
+		{
+			typedef std::chrono::steady_clock clock;
+
+			struct Entry
+			{
+				QueuedRequestPtr request;
+				clock::time_point queued;
+			};
+
+			struct Worker
+			{
+				std::mutex m_lock;
+				std::deque<Entry> m_queue;
+				std::atomic<size_t> m_depth;
+				std::atomic<bool> m_active;
+				std::atomic<bool> m_leaving; // next() lets the thread go
+				Worker() : m_depth(0), m_active(false), m_leaving(false) {}
+			};
+
+			std::unique_ptr<Worker[]> m_workers;
+			std::atomic<size_t> m_used; // slots ever taken; the rest is never looked at
+			std::atomic<size_t> m_next; // where the search for the shortest queue starts
+
+			// for the threads with nothing to do
+			std::mutex m_lock;
+			std::condition_variable m_ready;
+			size_t m_pending;
+			bool m_stopping;
+
+			// time spent in the queues, since the last sampleWait()
+			std::atomic<unsigned long long> m_waitTotal;
+			std::atomic<unsigned long long> m_waitCount;
+
+			Scheduler(const Scheduler&) = delete;
+			Scheduler& operator=(const Scheduler&) = delete;
+
+			QueuedRequestPtr pop(size_t slot);
+			QueuedRequestPtr steal(size_t thief);
+			void taken(clock::time_point queued);
+		public:
+			enum
+			{
+				MAX_WORKERS = 256,
+				NO_SLOT = (size_t)-1
+			};
+
+			Scheduler();
+
+			size_t attach(); // NO_SLOT, if all are taken
+			void detach(size_t slot); // whatever was left in the queue goes to the others
+			void leave(size_t slot); // the next() of that thread returns nullptr
+
+			void push(const QueuedRequestPtr& request);
+
+			// blocks until there is something to do; nullptr, once the
+			// scheduler is shut down
+			QueuedRequestPtr next(size_t slot);
+			void shutdown();
+
+			size_t depth(size_t slot) const;
+			size_t pending(); // all the queues together
+			unsigned long long sampleWait(); // mean wait in microseconds of the requests taken since the last call
+		};
+	}
+}
+
+#endif //__SCHEDULER_HPP__
@@ -26,7 +26,12 @@
 #define __FCGI_THREAD_HPP__
 
 #include <mt.hpp>
+#include <atomic>
 #include <fstream>
+#include <fast_cgi/arena.hpp>
+#include <fast_cgi/response_buffer.hpp>
+#include <fast_cgi/http_date.hpp>
+#include <fast_cgi/compression.hpp>
 
 namespace db
 {
@@ -50,11 +55,15 @@ namespace FastCGI
 		struct ThreadBackend
 		{
 			virtual void init() {}
+			virtual void setOutputBufferSize(size_t) {}
+			virtual bool listen(const std::string& /* address */) { return false; } // a socket of the thread's own, before init()
 			virtual const char * const* envp() const = 0;
 			virtual bool accept() = 0;
 			virtual void release() = 0;
 			virtual void shutdown() = 0;
-			virtual std::shared_ptr<RequestBackend> newRequestBackend() = 0;
+			virtual RequestBackend& requestBackend() = 0; // one per thread, valid after accept()
+			virtual size_t queueDepth() const { return 0; } // requests waiting for this thread
+			virtual void retire() {} // wakes the thread, if it can; otherwise, it leaves after the next request
 		};
 	};
 
@@ -65,12 +74,34 @@ namespace FastCGI
 		Application* m_app;
 		db::ConnectionPtr m_dbConn;
 		std::shared_ptr<impl::ThreadBackend> m_backend;
+		Arena m_arena; // per-request memory, reset after each request
+		ResponseBuffer m_output; // reused by all the requests of this thread
+		impl::Compressor m_compressor;
+		HttpDate m_lastModified;
+		HttpDate m_cookieExpires;
+		std::string m_cookieServer; // SERVER_NAME the m_cookieSuffix was built for
+		std::string m_cookieSuffix;
+		bool m_serializeAccept;
+
+		// kept by run(), sampled by the pool controller
+		std::atomic<long long> m_busyTime; // ns spent on the requests
+		std::atomic<long long> m_requestStart; // 0, while waiting for a request
+		std::atomic<unsigned long> m_load;
+		long long m_lastBusy;
+		long long m_lastSample;
+		std::atomic<bool> m_initialized;
+		std::atomic<bool> m_ownsSocket; // ACCEPT_REUSEPORT, listening on its own
+		std::atomic<bool> m_retiring;
+		std::atomic<bool> m_finished;
 	public:
 		Thread();
 		explicit Thread(const char* uri);
 		virtual ~Thread();
 
 		bool init();
+		// Picks the backend; called before the thread starts, as the
+		// other threads read m_backend without a lock afterwards.
+		void prepare();
 		void reload();
 		void setApplication(Application& app) { m_app = &app; }
 
@@ -84,7 +115,19 @@ namespace FastCGI
 		bool accept();
 		void handleRequest();
 		virtual void onRequest(Request& request) = 0;
-		virtual unsigned long getLoad() const = 0;
+
+		// Percent of the time spent on the requests, between the last two
+		// samples of the pool controller. A thread with a better idea of
+		// what keeps it busy may report its own figure, 0 to 100.
+		virtual unsigned long getLoad() const { return m_load; }
+		void sampleLoad();
+		size_t getQueueDepth() const { return m_backend->queueDepth(); }
+
+		// leave the pool; the thread finishes the current request first
+		void retire();
+		bool retiring() const { return m_retiring; }
+		bool ownsSocket() const { return m_ownsSocket; } // closed with the thread
+		bool finished() const { return m_finished; } // run() is over
 
 		void run();
 		void shutdown();
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef __URLENCODED_HPP__
+#define __URLENCODED_HPP__
+
+#include <string>
+
+namespace FastCGI
+{
+	namespace impl
+	{
+		struct UrlencodedHandler
+		{
+			virtual ~UrlencodedHandler() {}
+			// name and value are still url-encoded; value is null for "&name&"
+			virtual void onVariable(const char* name, size_t nameLength, bool nameEscaped,
+				const char* value, size_t valueLength, bool valueEscaped) = 0;
+		};
+
+		// Push tokenizer for application/x-www-form-urlencoded data. Pairs
+		// fully inside a chunk are reported in place; only a pair cut by the
+		// chunk boundary is carried over to the next feed().
+		class UrlencodedParser
+		{
+			UrlencodedHandler& m_handler;
+			std::string m_pending;
+			size_t m_maxFields;
+			size_t m_fields;
+
+			bool pair(const char* begin, const char* end);
+			bool pair(const char* begin, const char* eq, const char* end, bool nameEscaped, bool valueEscaped);
+		public:
+			explicit UrlencodedParser(UrlencodedHandler& handler, size_t maxFields = 0)
+				: m_handler(handler)
+				, m_maxFields(maxFields)
+				, m_fields(0)
+			{
+			}
+
+			// all return false, if there are more than maxFields fields
+			bool feed(const char* data, size_t size);
+			bool finish();
+			bool parse(const char* data, size_t size); // complete input, reported in place
+			size_t fields() const { return m_fields; }
+		};
+	}
+}
+
+#endif //__URLENCODED_HPP__
@@ -28,6 +28,7 @@
 #include <map>
 #include <string>
 #include <functional>
+#include <fast_cgi/response_buffer.hpp>
 
 namespace FastCGI {
 	class Control;
@@ -35,14 +36,15 @@ namespace FastCGI {
 	using Controls = std::list<ControlPtr>;
 
 	class Request;
-	inline std::ostream& req_ostream(Request&);
+	inline ResponseBuffer& req_output(Request&);
+	inline void req_written(Request&);
 
 	struct BasicRenderer;
 	using ChildrenCallback = std::function<void(Request&, BasicRenderer&)>;
 
 #ifndef REQUEST_OSTREAM
 #define REQUEST_OSTREAM
-	template <typename T> inline Request& operator << (Request& r, T&& in) { req_ostream(r) << in; return r; }
+	template <typename T> inline Request& operator << (Request& r, T&& in) { req_output(r) << in; req_written(r); return r; }
 #endif
 
 	typedef std::map<std::string, std::string> Strings;
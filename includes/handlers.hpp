@@ -51,6 +51,10 @@ namespace FastCGI { namespace app
 	public:
 		virtual ~Handler() {}
 		virtual bool allowsUploads() { return false; }
+		virtual bool allowsCompression() { return true; }
+		// the handler is also used for every resource below its own,
+		// unless a more specific handler is registered
+		virtual bool servesSubtree() { return false; }
 #if DEBUG_CGI
 		virtual std::string name() const = 0;
 #endif
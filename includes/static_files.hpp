@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __STATIC_FILES_HPP__
+#define __STATIC_FILES_HPP__
+
+#include <handlers.hpp>
+
+namespace FastCGI { namespace app
+{
+	// Serves the files from the application's data directory, e.g.
+	//
+	//     REGISTER_HANDLER("/static/", FastCGI::app::StaticFileHandler);
+	//
+	// answers "/static/css/site.css" with <data dir>/static/css/site.css.
+	// Small files are kept in memory, large ones are read as they are
+	// sent; a "file.gz" next to the "file" is sent instead, if the
+	// browser accepts gzip.
+	// Ranges are handled by Request::sendRanges().
+	//
+	// Paths with a segment starting with a dot (".git/", ".htaccess")
+	// are answered with 404, unless a subclass opts in with
+	// servesDotFiles(); "/.." is refused always.
+	class StaticFileHandler: public Handler
+	{
+	public:
+		enum
+		{
+			MAX_CACHED_FILE = 64 * 1024,
+			MAX_CACHE_SIZE = 16 * 1024 * 1024
+		};
+
+		DEBUG_NAME("static files");
+		bool servesSubtree() override { return true; }
+		virtual bool servesDotFiles() { return false; }
+		void visit(Request& request) override;
+
+		static const char* contentType(const std::string& path);
+	};
+}} // FastCGI::app
+
+#endif //__STATIC_FILES_HPP__
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include "tests.hpp"
+#include <fast_cgi/compression.hpp>
+
+using FastCGI::impl::Compressor;
+
+TEST(negotiate_nothing)
+{
+	CHECK(Compressor::negotiate(nullptr) == Compressor::NONE);
+	CHECK(Compressor::negotiate("") == Compressor::NONE);
+	CHECK(Compressor::negotiate("identity") == Compressor::NONE);
+	CHECK(Compressor::negotiate("br") == Compressor::NONE);
+}
+
+TEST(negotiate_plain)
+{
+	CHECK(Compressor::negotiate("gzip") == Compressor::GZIP);
+	CHECK(Compressor::negotiate("GZip") == Compressor::GZIP);
+	CHECK(Compressor::negotiate("x-gzip") == Compressor::GZIP);
+	CHECK(Compressor::negotiate("deflate") == Compressor::DEFLATE);
+	CHECK(Compressor::negotiate("gzip, deflate") == Compressor::GZIP);
+	CHECK(Compressor::negotiate("deflate, gzip") == Compressor::GZIP);
+	CHECK(Compressor::negotiate(" br , deflate ") == Compressor::DEFLATE);
+}
+
+TEST(negotiate_qvalues)
+{
+	CHECK(Compressor::negotiate("gzip;q=0.5, deflate") == Compressor::DEFLATE);
+	CHECK(Compressor::negotiate("gzip;q=0.5, deflate;q=0.4") == Compressor::GZIP);
+	CHECK(Compressor::negotiate("gzip; q=0.001, deflate;q=0") == Compressor::GZIP);
+	CHECK(Compressor::negotiate("gzip;q=0, deflate;q=0.000") == Compressor::NONE);
+	CHECK(Compressor::negotiate("gzip;Q=0.0") == Compressor::NONE);
+	CHECK(Compressor::negotiate("gzip;q=1.000, deflate;q=1") == Compressor::GZIP);
+}
+
+TEST(negotiate_wildcard)
+{
+	CHECK(Compressor::negotiate("*") == Compressor::GZIP);
+	CHECK(Compressor::negotiate("gzip;q=0, *") == Compressor::DEFLATE);
+	CHECK(Compressor::negotiate("gzip;q=0, deflate;q=0, *") == Compressor::NONE);
+	CHECK(Compressor::negotiate("*;q=0") == Compressor::NONE);
+	CHECK(Compressor::negotiate("*;q=0, deflate") == Compressor::DEFLATE);
+	CHECK(Compressor::negotiate("deflate, *;q=0.5") == Compressor::DEFLATE);
+	CHECK(Compressor::negotiate("deflate;q=0.2, *;q=0.5") == Compressor::GZIP);
+}
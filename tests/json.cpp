@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include "tests.hpp"
+#include <fast_cgi/json.hpp>
+#include <fast_cgi/response_buffer.hpp>
+#include <locale.h>
+
+using FastCGI::JsonWriter;
+using FastCGI::ResponseBuffer;
+
+static std::string contents(const ResponseBuffer& out)
+{
+	return std::string(out.data(), out.size());
+}
+
+TEST(json_escaping)
+{
+	ResponseBuffer out;
+	JsonWriter(out).value("quote\" backslash\\ slash/ \n\r\t\b\f \x01\x1f tail");
+	CHECK(contents(out) == "\"quote\\\" backslash\\\\ slash/ \\n\\r\\t\\b\\f \\u0001\\u001f tail\"");
+}
+
+TEST(json_escaping_utf8)
+{
+	// everything above the control characters goes through as it is
+	ResponseBuffer out;
+	JsonWriter(out).value("za\xc5\xbc\xc3\xb3\xc5\x82\xc4\x87 \x7f");
+	CHECK(contents(out) == "\"za\xc5\xbc\xc3\xb3\xc5\x82\xc4\x87 \x7f\"");
+}
+
+TEST(json_escaping_long_runs)
+{
+	// longer than any of the scan blocks, with the escapes at the edges
+	std::string text(100, 'a');
+	text[0] = '"';
+	text[15] = '\n';
+	text[16] = '\\';
+	text[99] = '\x02';
+
+	std::string expected = "\"\\\"" + std::string(14, 'a') + "\\n\\\\" + std::string(82, 'a') + "\\u0002\"";
+
+	ResponseBuffer out;
+	JsonWriter(out).value(FastCGI::param_view(text.data(), text.size()));
+	CHECK(contents(out) == expected);
+}
+
+TEST(json_structure)
+{
+	ResponseBuffer out;
+	JsonWriter json(out);
+	json.beginObject()
+		.member("id", 5)
+		.member("name", "x")
+		.member("none", (const char*)nullptr)
+		.key("tags").beginArray()
+			.value(true)
+			.value(-3ll)
+			.beginObject().endObject()
+			.beginArray().endArray()
+		.endArray()
+		.member("last", false)
+		.endObject();
+	CHECK(contents(out) == "{\"id\":5,\"name\":\"x\",\"none\":null,\"tags\":[true,-3,{},[]],\"last\":false}");
+}
+
+TEST(json_numbers)
+{
+	ResponseBuffer out;
+	JsonWriter json(out);
+	json.beginArray()
+		.value(0.5)
+		.value(0.1)
+		.value(1e300)
+		.value(0.0 / 0.0)
+		.endArray();
+	CHECK(contents(out) == "[0.5,0.1,1e+300,null]");
+}
+
+TEST(json_numbers_locale)
+{
+	// a decimal comma in the C locale must not leak into the JSON
+	const char* locales[] = { "pl_PL.UTF-8", "de_DE.UTF-8", "fr_FR.UTF-8", "pl_PL", "de_DE" };
+	std::string previous = setlocale(LC_NUMERIC, nullptr);
+	for (auto&& name : locales)
+	{
+		if (!setlocale(LC_NUMERIC, name))
+			continue;
+
+		ResponseBuffer out;
+		JsonWriter(out).value(2.25);
+		CHECK(contents(out) == "2.25");
+		break;
+	}
+	setlocale(LC_NUMERIC, previous.c_str());
+}
+
+#ifdef NDEBUG
+TEST(json_too_deep)
+{
+	// debug builds assert on this
+	ResponseBuffer out;
+	JsonWriter json(out);
+	for (int i = 0; i < JsonWriter::MAX_DEPTH + 2; ++i)
+		json.beginArray().value(i);
+	for (int i = 0; i < JsonWriter::MAX_DEPTH + 2; ++i)
+		json.endArray();
+	json.value("after");
+
+	std::string expected;
+	for (int i = 0; i < JsonWriter::MAX_DEPTH; ++i)
+		expected += "[" + std::to_string(i) + ",";
+	expected += "null";
+	for (int i = 0; i < JsonWriter::MAX_DEPTH; ++i)
+		expected += "]";
+	expected += "\"after\"";
+	CHECK(contents(out) == expected);
+}
+#endif
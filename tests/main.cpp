@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include "tests.hpp"
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+namespace tests
+{
+	struct Test
+	{
+		const char* name;
+		TestFunction test;
+	};
+
+	static std::vector<Test>& registry()
+	{
+		static std::vector<Test> tests;
+		return tests;
+	}
+
+	static bool s_passed = true;
+
+	Registrar::Registrar(const char* name, TestFunction test)
+	{
+		registry().push_back({ name, test });
+	}
+
+	void check(bool passed, const char* expr, const char* file, int line)
+	{
+		if (passed)
+			return;
+		s_passed = false;
+		fprintf(stderr, "%s(%d): CHECK(%s) failed\n", file, line, expr);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	// with arguments, runs only the tests named
+	int failed = 0, run = 0;
+	for (auto&& test : tests::registry())
+	{
+		if (argc > 1)
+		{
+			bool selected = false;
+			for (int i = 1; i < argc && !selected; ++i)
+				selected = !strcmp(argv[i], test.name);
+			if (!selected)
+				continue;
+		}
+
+		tests::s_passed = true;
+		test.test();
+		++run;
+		if (!tests::s_passed)
+		{
+			++failed;
+			fprintf(stderr, "FAILED: %s\n", test.name);
+		}
+	}
+
+	printf("%d of %d tests passed\n", run - failed, run);
+	return failed;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include "tests.hpp"
+#include <fast_cgi/multipart.hpp>
+
+using FastCGI::UploadInfo;
+using FastCGI::impl::MultipartHandler;
+using FastCGI::impl::MultipartParser;
+
+namespace
+{
+	// writes down everything the parser reports, one line per event;
+	// the file contents, which may come in any number of pieces, are
+	// written down together, when the file is closed
+	struct Recorder: MultipartHandler
+	{
+		std::string log;
+		std::string file;
+
+		bool onField(const std::string& name, const std::string& value) override
+		{
+			log += "field " + name + "=" + value + "\n";
+			return true;
+		}
+		bool onFileOpen(const UploadInfo& info) override
+		{
+			log += "open " + info.name + " " + info.filename + " " + info.contentType + "\n";
+			file.clear();
+			return true;
+		}
+		bool onFileData(const char* data, size_t size) override
+		{
+			file.append(data, size);
+			return true;
+		}
+		void onFileClose() override
+		{
+			log += "data " + file + "\nclose\n";
+		}
+	};
+
+	const char body[] =
+		"preamble\r\n"
+		"--XyZ\r\n"
+		"Content-Disposition: form-data; name=\"title\"\r\n"
+		"\r\n"
+		"Hello, --XyZ world\r\n"
+		"--XyZ\r\n"
+		"content-disposition: form-data; name=\"file\"; filename=\"C:\\\\dir\\\\a.txt\"\r\n"
+		"Content-Type: text/plain\r\n"
+		"\r\n"
+		"line one\r\nline two\r\n\r\n"
+		"--XyZ\r\n"
+		"Content-Disposition: form-data; name=\"empty\"; filename=\"\"\r\n"
+		"Content-Type: application/octet-stream\r\n"
+		"\r\n"
+		"\r\n"
+		"--XyZ--\r\n"
+		"epilogue";
+
+	const char expected[] =
+		"field title=Hello, --XyZ world\n"
+		"open file a.txt text/plain\n"
+		"data line one\r\nline two\r\n\n"
+		"close\n";
+}
+
+TEST(multipart_boundary)
+{
+	CHECK(MultipartParser::boundary("multipart/form-data; boundary=XyZ") == "XyZ");
+	CHECK(MultipartParser::boundary("multipart/form-data;boundary=\"a b\"; charset=utf-8") == "a b");
+	CHECK(MultipartParser::boundary("multipart/form-data; charset=utf-8; boundary=abc ; x=y") == "abc");
+	CHECK(MultipartParser::boundary("multipart/form-data; boundary=\"open") == "");
+	CHECK(MultipartParser::boundary("multipart/form-data") == "");
+	CHECK(MultipartParser::boundary(nullptr) == "");
+}
+
+TEST(multipart_whole)
+{
+	Recorder rec;
+	MultipartParser parser("XyZ", rec);
+	CHECK(parser.feed(body, sizeof(body) - 1));
+	CHECK(parser.finished());
+	CHECK(rec.log == expected);
+}
+
+TEST(multipart_byte_by_byte)
+{
+	Recorder rec;
+	MultipartParser parser("XyZ", rec);
+	for (size_t i = 0; i < sizeof(body) - 1; ++i)
+		CHECK(parser.feed(body + i, 1));
+	CHECK(parser.finished());
+	CHECK(rec.log == expected);
+}
+
+TEST(multipart_field_too_large)
+{
+	Recorder rec;
+	MultipartParser parser("XyZ", rec, 8);
+	CHECK(!parser.feed(body, sizeof(body) - 1));
+	CHECK(parser.failed());
+	CHECK(parser.tooLarge());
+}
+
+TEST(multipart_malformed)
+{
+	Recorder rec;
+	MultipartParser parser("XyZ", rec);
+	const char nameless[] = "--XyZ\r\nContent-Type: text/plain\r\n\r\nvalue\r\n--XyZ--";
+	CHECK(!parser.feed(nameless, sizeof(nameless) - 1));
+	CHECK(parser.failed());
+	CHECK(!parser.tooLarge());
+}
+
+TEST(multipart_unfinished)
+{
+	Recorder rec;
+	MultipartParser parser("XyZ", rec);
+	const char partial[] = "--XyZ\r\nContent-Disposition: form-data; name=\"a\"\r\n\r\nvalue";
+	CHECK(parser.feed(partial, sizeof(partial) - 1));
+	CHECK(!parser.finished());
+	CHECK(rec.log.empty());
+}
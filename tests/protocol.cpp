@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include "tests.hpp"
+#include <fast_cgi/protocol.hpp>
+
+namespace protocol = FastCGI::impl::protocol;
+
+static std::string record(unsigned char type, unsigned short id, const std::string& content, unsigned char padding = 0)
+{
+	unsigned char header[protocol::HEADER_SIZE];
+	protocol::recordHeader(header, type, id, content.length());
+	header[6] = padding;
+	return std::string((const char*)header, sizeof(header)) + content + std::string(padding, '\0');
+}
+
+static std::string nameValue(const std::string& name, const std::string& value)
+{
+	std::string out;
+	protocol::appendNameValue(out, name.data(), name.length(), value);
+	return out;
+}
+
+TEST(protocol_read_record)
+{
+	std::string data = record(protocol::STDIN, 0x1234, "hello", 3) + record(protocol::PARAMS, 1, "");
+
+	protocol::Record rec;
+	size_t consumed = 0;
+	CHECK(protocol::readRecord(data.data(), data.length(), rec, consumed) == protocol::RECORD);
+	CHECK(rec.type == protocol::STDIN);
+	CHECK(rec.id == 0x1234);
+	CHECK(std::string(rec.content, rec.length) == "hello");
+	CHECK(consumed == protocol::HEADER_SIZE + 5 + 3);
+
+	size_t rest = data.length() - consumed;
+	CHECK(protocol::readRecord(data.data() + consumed, rest, rec, consumed) == protocol::RECORD);
+	CHECK(rec.type == protocol::PARAMS);
+	CHECK(rec.id == 1);
+	CHECK(rec.length == 0);
+	CHECK(consumed == rest);
+}
+
+TEST(protocol_read_partial)
+{
+	std::string data = record(protocol::STDIN, 1, "hello", 3);
+
+	protocol::Record rec;
+	size_t consumed = 0;
+	for (size_t size = 0; size < data.length(); ++size)
+		CHECK(protocol::readRecord(data.data(), size, rec, consumed) == protocol::PARTIAL);
+	CHECK(protocol::readRecord(data.data(), data.length(), rec, consumed) == protocol::RECORD);
+}
+
+TEST(protocol_read_malformed)
+{
+	std::string data = record(protocol::STDIN, 1, "x");
+	data[0] = 2;
+
+	protocol::Record rec;
+	size_t consumed = 0;
+	CHECK(protocol::readRecord(data.data(), data.length(), rec, consumed) == protocol::MALFORMED);
+	CHECK(protocol::readRecord("GET / HTTP/1.1\r\n", 16, rec, consumed) == protocol::MALFORMED);
+}
+
+TEST(protocol_end_request)
+{
+	unsigned char out[protocol::HEADER_SIZE + 8];
+	protocol::endRequest(out, 0x0102, protocol::OVERLOADED);
+
+	protocol::Record rec;
+	size_t consumed = 0;
+	CHECK(protocol::readRecord((const char*)out, sizeof(out), rec, consumed) == protocol::RECORD);
+	CHECK(rec.type == protocol::END_REQUEST);
+	CHECK(rec.id == 0x0102);
+	CHECK(rec.length == 8);
+	CHECK(rec.content[4] == protocol::OVERLOADED);
+	CHECK(consumed == sizeof(out));
+}
+
+TEST(protocol_decode_params)
+{
+	std::string longValue(300, 'v');
+	std::string params = nameValue("REQUEST_METHOD", "GET")
+		+ nameValue("QUERY_STRING", "")
+		+ nameValue("HTTP_X_LONG", longValue)
+		+ nameValue(std::string(200, 'N'), "1");
+
+	std::vector<const char*> envp;
+	CHECK(protocol::decodeParams(params, envp));
+	CHECK(envp.size() == 5);
+	if (envp.size() != 5)
+		return;
+
+	CHECK(!strcmp(envp[0], "REQUEST_METHOD=GET"));
+	CHECK(!strcmp(envp[1], "QUERY_STRING="));
+	CHECK(envp[2] == "HTTP_X_LONG=" + longValue);
+	CHECK(envp[3] == std::string(200, 'N') + "=1");
+	CHECK(envp[4] == nullptr);
+	CHECK(envp[0] == params.data());
+}
+
+TEST(protocol_decode_params_empty)
+{
+	std::string params;
+	std::vector<const char*> envp;
+	CHECK(protocol::decodeParams(params, envp));
+	CHECK(envp.size() == 1 && envp[0] == nullptr);
+}
+
+TEST(protocol_decode_params_truncated)
+{
+	std::string full = nameValue("REQUEST_METHOD", "GET") + nameValue("HTTP_X_LONG", std::string(300, 'v'));
+	for (size_t size = 1; size < full.length(); ++size)
+	{
+		// cut at the end of the first pair, the rest is still whole
+		if (size == nameValue("REQUEST_METHOD", "GET").length())
+			continue;
+
+		std::string params = full.substr(0, size);
+		std::vector<const char*> envp;
+		CHECK(!protocol::decodeParams(params, envp));
+	}
+}
+
+TEST(protocol_get_values)
+{
+	std::string query = nameValue("FCGI_MAX_CONNS", "") + nameValue("FCGI_MPXS_CONNS", "");
+	const char* c = query.data();
+	const char* end = c + query.length();
+
+	const char* name;
+	size_t length;
+	CHECK(protocol::nextName(c, end, name, length) && std::string(name, length) == "FCGI_MAX_CONNS");
+	CHECK(protocol::nextName(c, end, name, length) && std::string(name, length) == "FCGI_MPXS_CONNS");
+	CHECK(c == end);
+	CHECK(!protocol::nextName(c, end, name, length));
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include "tests.hpp"
+#include <fast_cgi/ranges.hpp>
+
+using FastCGI::impl::ByteRanges;
+
+// the ranges as "first-last,first-last"
+static std::string parsed(const ByteRanges& ranges)
+{
+	std::string out;
+	for (auto&& range : ranges.ranges())
+	{
+		if (!out.empty())
+			out += ',';
+		out += std::to_string(range.first) + "-" + std::to_string(range.last);
+	}
+	return out;
+}
+
+TEST(ranges_single)
+{
+	ByteRanges ranges;
+	CHECK(ranges.parse("bytes=0-499", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "0-499");
+	CHECK(ranges[0].length() == 500);
+
+	CHECK(ranges.parse("bytes=500-", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "500-999");
+
+	CHECK(ranges.parse("bytes=-200", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "800-999");
+
+	CHECK(ranges.parse("bytes=-2000", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "0-999");
+
+	CHECK(ranges.parse("bytes=900-5000", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "900-999");
+
+	CHECK(ranges.parse("bytes = 1 - 2", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes= 1 - 2 ", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "1-2");
+}
+
+TEST(ranges_merged)
+{
+	ByteRanges ranges;
+	CHECK(ranges.parse("bytes=500-599,0-99,100-199,550-700", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "0-199,500-700");
+
+	CHECK(ranges.parse("bytes=,0-9,,20-29,", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "0-9,20-29");
+
+	CHECK(ranges.parse("bytes=0-,-1", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "0-999");
+}
+
+TEST(ranges_unsatisfiable)
+{
+	ByteRanges ranges;
+	CHECK(ranges.parse("bytes=1000-", 1000) == ByteRanges::UNSATISFIABLE);
+	CHECK(ranges.parse("bytes=1000-1999,5000-", 1000) == ByteRanges::UNSATISFIABLE);
+	CHECK(ranges.parse("bytes=-0", 1000) == ByteRanges::UNSATISFIABLE);
+	CHECK(ranges.parse("bytes=0-10", 0) == ByteRanges::UNSATISFIABLE);
+
+	// the satisfiable ones are kept
+	CHECK(ranges.parse("bytes=2000-,10-19", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "10-19");
+}
+
+TEST(ranges_invalid)
+{
+	ByteRanges ranges;
+	CHECK(ranges.parse(nullptr, 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("items=0-1", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes=", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes=-", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes=5-1", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes=1-2x", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes=0-1;2-3", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes=a-b", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes=99999999999999999999-", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes=0-184467440737095516160", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.parse("bytes=0-30000000000000000000", 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.count() == 0);
+
+	// the largest number there is still fits
+	CHECK(ranges.parse("bytes=0-18446744073709551615", 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "0-999");
+}
+
+TEST(ranges_too_many)
+{
+	std::string header = "bytes=";
+	for (int i = 0; i <= ByteRanges::MAX_RANGES; ++i)
+		header += std::to_string(i * 10) + "-" + std::to_string(i * 10 + 1) + ",";
+
+	ByteRanges ranges;
+	CHECK(ranges.parse(header.c_str(), 1000) == ByteRanges::WHOLE);
+	CHECK(ranges.count() == 0);
+
+	// merged down to one, so allowed
+	header = "bytes=";
+	for (int i = 0; i <= ByteRanges::MAX_RANGES; ++i)
+		header += std::to_string(i) + "-" + std::to_string(i) + ",";
+	CHECK(ranges.parse(header.c_str(), 1000) == ByteRanges::PARTIAL);
+	CHECK(parsed(ranges) == "0-" + std::to_string((int)ByteRanges::MAX_RANGES));
+}
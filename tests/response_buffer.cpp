@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include "tests.hpp"
+#include <fast_cgi/response_buffer.hpp>
+#include <limits.h>
+#include <locale.h>
+
+using FastCGI::ResponseBuffer;
+
+static std::string contents(const ResponseBuffer& out)
+{
+	return std::string(out.data(), out.size());
+}
+
+TEST(response_buffer_numbers)
+{
+	ResponseBuffer out;
+	out << 0 << ' ' << -17 << ' ' << LLONG_MIN << ' ' << ULLONG_MAX;
+	CHECK(contents(out) == "0 -17 -9223372036854775808 18446744073709551615");
+
+	out.clear();
+	out << 2.5 << ' ' << 1e300 << ' ' << -1.0 / 0.0 << ' ' << 1.0 / 3;
+	CHECK(contents(out) == "2.5 1e+300 -inf 0.333333");
+}
+
+TEST(response_buffer_numbers_locale)
+{
+	// the stream does not follow the LC_NUMERIC, neither may the shortcut
+	const char* locales[] = { "pl_PL.UTF-8", "de_DE.UTF-8", "fr_FR.UTF-8", "pl_PL", "de_DE" };
+	std::string previous = setlocale(LC_NUMERIC, nullptr);
+	for (auto&& name : locales)
+	{
+		if (!setlocale(LC_NUMERIC, name))
+			continue;
+
+		ResponseBuffer out;
+		out << 2.25;
+		CHECK(contents(out) == "2.25");
+		break;
+	}
+	setlocale(LC_NUMERIC, previous.c_str());
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __TESTS_HPP__
+#define __TESTS_HPP__
+
+// A handful of macros, just enough to keep the parsers honest:
+//
+//     TEST(negotiate_gzip)
+//     {
+//         CHECK(Compressor::negotiate("gzip") == Compressor::GZIP);
+//     }
+//
+// Every TEST in the linked files runs once; the exit code is the
+// number of the tests with a failed CHECK.
+
+namespace tests
+{
+	typedef void (*TestFunction)();
+
+	struct Registrar
+	{
+		Registrar(const char* name, TestFunction test);
+	};
+
+	void check(bool passed, const char* expr, const char* file, int line);
+}
+
+#define TEST(name) \
+	static void test_##name(); \
+	static tests::Registrar register_##name(#name, test_##name); \
+	static void test_##name()
+
+#define CHECK(expr) tests::check(!!(expr), #expr, __FILE__, __LINE__)
+
+#endif //__TESTS_HPP__
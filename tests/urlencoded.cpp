@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2013 midnightBITS
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pch.h"
+#include "tests.hpp"
+#include <fast_cgi/urlencoded.hpp>
+#include <fast_cgi/scan.hpp>
+
+using FastCGI::impl::UrlencodedHandler;
+using FastCGI::impl::UrlencodedParser;
+namespace scan = FastCGI::impl::scan;
+
+namespace
+{
+	// "name=value;" for each variable, with a '%' after the part,
+	// which still needs decoding, and no '=' for the names alone
+	struct Recorder: UrlencodedHandler
+	{
+		std::string log;
+
+		void onVariable(const char* name, size_t nameLength, bool nameEscaped,
+			const char* value, size_t valueLength, bool valueEscaped) override
+		{
+			log.append(name, nameLength);
+			if (nameEscaped)
+				log += '%';
+			if (value)
+			{
+				log += '=';
+				log.append(value, valueLength);
+				if (valueEscaped)
+					log += '%';
+			}
+			log += ';';
+		}
+	};
+
+	const char form[] = "a=1&b=two+words& c = spaced &&flag&e%3D=x%26y&empty=&long=0123456789abcdefghijklmnopqrstuvwxyz0123456789&last=end";
+	const char expected[] = "a=1;b=two+words%;c=spaced;flag;e%3D%=x%26y%;empty=;long=0123456789abcdefghijklmnopqrstuvwxyz0123456789;last=end;";
+
+	std::string decode(const char* text)
+	{
+		std::string out(strlen(text), '\0');
+		out.resize(scan::decode(text, out.length(), &out[0]));
+		return out;
+	}
+}
+
+TEST(urlencoded_parse)
+{
+	Recorder rec;
+	UrlencodedParser parser(rec);
+	CHECK(parser.parse(form, sizeof(form) - 1));
+	CHECK(rec.log == expected);
+	CHECK(parser.fields() == 8);
+}
+
+TEST(urlencoded_any_chunks)
+{
+	// every chunk size, so each pair gets cut at each place
+	for (size_t chunk = 1; chunk < sizeof(form); ++chunk)
+	{
+		Recorder rec;
+		UrlencodedParser parser(rec);
+		for (size_t pos = 0; pos < sizeof(form) - 1; pos += chunk)
+		{
+			size_t size = sizeof(form) - 1 - pos;
+			CHECK(parser.feed(form + pos, size < chunk ? size : chunk));
+		}
+		CHECK(parser.finish());
+		CHECK(rec.log == expected);
+	}
+}
+
+TEST(urlencoded_max_fields)
+{
+	Recorder rec;
+	UrlencodedParser parser(rec, 3);
+	CHECK(!parser.parse(form, sizeof(form) - 1));
+	CHECK(rec.log == "a=1;b=two+words%;c=spaced;");
+
+	Recorder fed;
+	UrlencodedParser chunked(fed, 3);
+	bool ok = true;
+	for (size_t pos = 0; ok && pos < sizeof(form) - 1; pos += 5)
+	{
+		size_t size = sizeof(form) - 1 - pos;
+		ok = chunked.feed(form + pos, size < 5 ? size : 5);
+	}
+	CHECK(!ok);
+}
+
+TEST(urlencoded_empty)
+{
+	Recorder rec;
+	UrlencodedParser parser(rec);
+	CHECK(parser.parse("", 0));
+	CHECK(parser.parse("&&&", 3));
+	CHECK(parser.finish());
+	CHECK(rec.log.empty());
+}
+
+TEST(urlencoded_decode)
+{
+	CHECK(decode("plain") == "plain");
+	CHECK(decode("two+words") == "two words");
+	CHECK(decode("%41%62%2b%2B") == "Ab++");
+	CHECK(decode("za%C5%BC%c3%b3%C5%82%C4%87") == "za\xc5\xbc\xc3\xb3\xc5\x82\xc4\x87");
+	CHECK(decode("bad%zzhex") == "bad%zzhex");
+	CHECK(decode("cut%4") == "cut%4");
+	CHECK(decode("cut%") == "cut%");
+}